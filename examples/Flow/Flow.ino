@@ -75,8 +75,6 @@ static const uint8_t INCV = 8;
 
 // recall from note above that image arrays are stored row-size in a 1D array
 
-static uint16_t last_img[MAX_PIXELS];         //1D image array
-static uint16_t current_img[MAX_PIXELS];
 static uint16_t row = MAX_ROWS;            //maximum rows allowed by memory
 static uint16_t col = MAX_COLS;            //maximum cols allowed by memory
 static uint16_t skiprow = SKIP_PIXELS;     //pixels to be skipped during readout because of downsampling
@@ -98,14 +96,22 @@ static uint16_t mask_base=0; // FPN calibration image base.
 static char command; // command character
 static int commandArgument; // argument of command
 
-//a set of vectors to send down
-static int8_t vectors[2];
+//a set of vectors to send down, one for each patch
+static int8_t vectors[2*OFO_TUNE_GRID*OFO_TUNE_GRID];
 
 static uint8_t OFType;
 
 //optical flow X and Y
-static int16_t filtered_OFX,filtered_OFY;
-static int16_t OFX,OFY;
+static int16_t filtered_OF[2];
+static int16_t OF[2];
+
+//low-pass filter parameter 0.35, in fixed point
+static const uint16_t LPF_ALPHA = ofoAlphaQ15(0.35);
+
+//flow method and grid of patches chosen by the autotuner, and the time
+//per frame it may take, in microseconds
+static FlowTuning tuning;
+static const uint32_t FLOW_BUDGET_USEC = 2000;
 
 //object representing our sensor
 static Stonyman stonyman(RESP, INCP, RESV, INCV);
@@ -113,9 +119,32 @@ static Stonyman stonyman(RESP, INCP, RESV, INCV);
 //object for communicating with GUI
 static GUIClient gui;
 
+//object for acquiring images and computing optical flow between the last two;
+//it holds the current and last images
+static FlowFrameGrabber flowgrabber(MAX_ROWS, MAX_COLS, 200);
+
 //=======================================================================
 // FUNCTIONS DEFINED FOR THIS SKETCH
 
+// the autotune function times each optical flow method on a few grids of
+// patches of two live images, chooses the best that fits in the time budget,
+// and saves the choice in EEPROM so the next startup can skip this
+static void autotune()
+{
+    ImageBounds bounds(sr,row,skiprow,sc,col,skipcol);
+    stonyman.processFrame(flowgrabber, inputPin, bounds);
+    stonyman.processFrame(flowgrabber, inputPin, bounds);
+
+    //masked ten-bit pixels span eleven bits
+    ofoAutotune<uint16_t,11>(ImageView<uint16_t>(flowgrabber.getImage(),row,col),
+                             ImageView<uint16_t>(flowgrabber.getPreviousImage(),row,col),
+                             FLOW_BUDGET_USEC, micros, 4, &tuning);
+    ofoTuningSave(&tuning);
+
+    flowgrabber.setMethod(tuning.method);
+    flowgrabber.setGrid(tuning.grid);
+}
+
 // the processCommands function reads and responds to commands sent to
 // the Arduino over the serial connection.  
 static void processCommands()
@@ -156,8 +185,10 @@ static void processCommands()
             case 'f': 
                 {
                     ImageBounds bounds(sr,row,skiprow,sc,col,skipcol);
+                    uint16_t * current_img = flowgrabber.getImage();
                     stonymanGetImage(stonyman, current_img, inputPin, bounds);
                     imgCalcMask(current_img,row*col,mask,&mask_base);
+                    flowgrabber.setMask(mask,mask_base);
                     Serial.println("FPN Mask done");  
                 }
                 break;   
@@ -165,6 +196,15 @@ static void processCommands()
                 //optical flow type  
             case 'o':
                 OFType=commandArgument;
+                flowgrabber.setMethod(OFType);
+                tuning.method=OFType;
+                break;
+
+                //autotune optical flow method and grid
+            case 't':
+                autotune();
+                sprintf(charbuf,"method= %d grid= %d",tuning.method,tuning.grid);
+                Serial.println(charbuf);
                 break;
 
                 //change chip select
@@ -179,6 +219,7 @@ static void processCommands()
                 Serial.println("a: ADC"); 
                 Serial.println("f: FPN mask"); 
                 Serial.println("s: chip select");
+                Serial.println("t: autotune");
                 break;
 
             default:
@@ -204,6 +245,15 @@ void setup()
 
     //set the initial binning on the vision chip
     stonyman.setBinning(skipcol,skiprow);
+
+    //use the flow method and grid tuned on an earlier run, or tune them now
+    if (ofoTuningLoad(&tuning,row,col))
+    {
+        flowgrabber.setMethod(tuning.method);
+        flowgrabber.setGrid(tuning.grid);
+    }
+    else
+        autotune();
 }
 
 void loop() 
@@ -211,49 +261,49 @@ void loop()
     //process commands from serial (should be performed once every execution of loop())
     processCommands();
 
-    //get an image from the stonyman chip
+    //get an image from the stonyman chip.  The flow grabber applies the FPN mask
+    //and computes optical flow while the image is being read, so there is no
+    //need to make further passes over the image.  The FPN mask needs to be
+    //calculated with the "f" command while the vision chip is covered with a
+    //white sheet of paper to expose it to uniform illumination.  Once calculated,
+    //it will remove fixed-pattern noise  
     ImageBounds bounds(sr,row,skiprow,sc,col,skipcol);
-    stonymanGetImage(stonyman, current_img, inputPin, bounds);
-
-    //apply an FPNMask to the image.  This needs to be calculated with the "f" command
-    //while the vision chip is covered with a white sheet of paper to expose it to 
-    //uniform illumination.  Once calculated, it will remove fixed-pattern noise  
-    imgApplyMask(current_img,row*col,mask,mask_base);
+    stonyman.processFrame(flowgrabber, inputPin, bounds);
 
     //if GUI is enabled then send image for display
-    gui.sendImage(row,col,current_img,row*col);
-
-    //calculate optical flow
-
-    //Image Interpolation 2D with standard "plus" shifting
-    if(OFType==0)
-        ofoIIA_Plus_2D(current_img,last_img,row,col,200,&OFX,&OFY);
-    //Image Interpolation 2D with compact "square" shifting
-    if(OFType==1)
-        ofoIIA_Square_2D(current_img,last_img,row,col,200,&OFX,&OFY);
-    //Lucas Kanade 2D with standard "plus" shifting
-    if(OFType==2)
-        ofoLK_Plus_2D(current_img,last_img,row,col,200,&OFX,&OFY);
-    //Lucas Kanade 2D with compact "square" shifting
-    if(OFType==3)
-        ofoLK_Square_2D(current_img,last_img,row,col,200,&OFX,&OFY);
-
-    //low pass filter the X shift
-    ofoLPF(&filtered_OFX,&OFX,0.35);
-
-    //low pass filter the Y shift
-    ofoLPF(&filtered_OFY,&OFY,0.35);
-
-    //put filtered shifts into array to send to GUI
-    vectors[0]=filtered_OFX;    //vector1 x
-    vectors[1]=filtered_OFY;     //vector1 y
-
-    //send shifts to be displayed on GUI
-    gui.sendVectors(1,1,vectors,1);
-
-    //copy current_img to last_img so two frames are kept
-    //for optical flow calculation
-    imgCopy(current_img,last_img,row*col);
+    gui.sendImage(row,col,flowgrabber.getImage(),row*col);
+
+    //get optical flow, computed using the method selected by the "o" command
+    flowgrabber.getFlow(&OF[0],&OF[1]);
+
+    //low pass filter the X and Y shifts
+    ofoLPF_Q15(filtered_OF,OF,2,LPF_ALPHA);
+
+    if (tuning.grid>1)
+    {
+        //get the flow of each patch of the grid chosen by the autotuner, which
+        //the flow grabber also computed during readout
+        int16_t gridx[OFO_TUNE_GRID*OFO_TUNE_GRID];
+        int16_t gridy[OFO_TUNE_GRID*OFO_TUNE_GRID];
+        flowgrabber.getGridFlow(gridx,gridy);
+        for (uint8_t k=0; k<tuning.grid*tuning.grid; ++k)
+        {
+            vectors[2*k]=gridx[k];
+            vectors[2*k+1]=gridy[k];
+        }
+
+        //send shifts to be displayed on GUI
+        gui.sendVectors(tuning.grid,tuning.grid,vectors,tuning.grid*tuning.grid);
+    }
+    else
+    {
+        //put filtered shifts into array to send to GUI
+        vectors[0]=filtered_OF[0];    //vector1 x
+        vectors[1]=filtered_OF[1];    //vector1 y
+
+        //send shifts to be displayed on GUI
+        gui.sendVectors(1,1,vectors,1);
+    }
 
     //small delay
     delay(5);
@@ -0,0 +1,146 @@
+/* Asynchronous Optical Flow example
+
+   This sketch computes optical flow on one frame while the Stonyman chip 
+   reads the next.  A timer interrupt reads one pixel each time it fires, 
+   through Stonyman::stepAsync(), into one of two image buffers; the loop 
+   takes each completed frame with Stonyman::getAsyncFrame(), computes the 
+   flow between it and the previous frame, and releases it.  The readout 
+   thus never waits for the flow, nor the flow for the readout, and the 
+   frame rate is set by the slower of the two rather than their sum.  
+
+   The flow and the number of frames dropped (read while the loop was still
+   busy with an earlier one) are sent to the GUI program in extras/processing
+   and printed.
+
+   This example uses Timer1 of AVR boards such as the Uno, Nano and Mega.
+
+   Copyright (C) 2017 Simon D. Levy
+ */
+
+#include <Stonyman.h>       // Stonyman vision chip library
+#include <GUIClient.h>      // ArduEye processing GUI interface
+#include <OpticalFlow.h>    // Optical Flow support
+
+#include <SPI.h>  //SPI library is needed to use an external ADC
+
+#if !defined(__AVR__)
+#error "This example uses the AVR Timer1 interrupt; on other boards, call stepAsync() from a timer of your own"
+#endif
+
+//==============================================================================
+// GLOBAL VARIABLES
+
+// pins
+static const uint8_t RESP = 3;
+static const uint8_t INCP = 4;
+static const uint8_t RESV = 5;
+static const uint8_t INCV = 8;
+
+static const uint8_t INPUT_PIN = 0;  //which vision chip to read from
+
+// Time between pixels, in microseconds.  The interrupt must finish reading a 
+// pixel before the next one is due; analogRead() takes about 112 microseconds 
+// with the default ADC clock, so 200 reads a 16x16 frame about 20 times a second, 
+// leaving most of the processor to the loop.
+static const uint16_t PIXEL_USEC = 200;
+
+// Frames alternate between these buffers; the one the loop holds is never
+// written until it is released
+static uint16_t buf1[MAX_PIXELS];
+static uint16_t buf2[MAX_PIXELS];
+
+// Previous frame, kept so that the buffer can be released as soon as possible
+static uint16_t last[MAX_PIXELS];
+static bool have_last;
+
+//optical flow X and Y, and low-pass filtered
+static int16_t OF[2];
+static int16_t filtered_OF[2];
+static int8_t vectors[2];
+
+//low-pass filter parameter 0.35, in fixed point
+static const uint16_t LPF_ALPHA = ofoAlphaQ15(0.35);
+
+//object representing our sensor
+static Stonyman stonyman(RESP, INCP, RESV, INCV);
+
+//object for communicating with GUI
+static GUIClient gui;
+
+//=======================================================================
+// TIMER INTERRUPT
+
+// Reads the next pixel.  This is the only place stepAsync() is called, so it 
+// cannot interrupt itself, and the loop's calls cannot interrupt it.
+ISR(TIMER1_COMPA_vect)
+{
+    stonyman.stepAsync();
+}
+
+// Fires the interrupt every PIXEL_USEC microseconds: Timer1 in CTC mode, counting 
+// at F_CPU/8 (2 MHz on a 16 MHz board)
+static void startTimer()
+{
+    noInterrupts();
+    TCCR1A = 0;
+    TCCR1B = (1 << WGM12) | (1 << CS11);
+    TCNT1  = 0;
+    OCR1A  = (uint16_t)((F_CPU / 8 / 1000000UL) * PIXEL_USEC - 1);
+    TIMSK1 |= (1 << OCIE1A);
+    interrupts();
+}
+
+//=======================================================================
+// ARDUINO SETUP AND LOOP FUNCTIONS
+
+void setup() 
+{
+    // initialize serial port
+    Serial.begin(115200); //GUI defaults to this baud rate
+
+    //initialize SPI (needed for external ADC)
+    SPI.begin();
+
+    //initialize ArduEye Stonyman
+    stonyman.begin();
+
+    //set the initial binning on the vision chip
+    stonyman.setBinning(SKIP_PIXELS,SKIP_PIXELS);
+
+    //start reading frames in the background
+    ImageBounds bounds(START_ROW,MAX_ROWS,SKIP_PIXELS,START_COL,MAX_COLS,SKIP_PIXELS);
+    stonyman.startAsync(buf1, buf2, INPUT_PIN, bounds);
+    startTimer();
+}
+
+void loop() 
+{
+    //the freshest completed frame, or NULL if none has been completed since 
+    //the last one was released
+    uint16_t * frame = stonyman.getAsyncFrame();
+
+    if (!frame)
+        return;
+
+    //raw ten-bit pixels from the Arduino ADC
+    if (have_last)
+        ofoIIA_Plus_2D<uint16_t,10>(frame, last, MAX_ROWS, MAX_COLS, 256, &OF[0], &OF[1]);
+
+    //keep the frame for the next flow, and give its buffer back to the readout
+    memcpy(last, frame, sizeof(last));
+    have_last = true;
+    stonyman.releaseAsyncFrame();
+
+    //low pass filter the X and Y shifts
+    ofoLPF_Q15(filtered_OF,OF,2,LPF_ALPHA);
+
+    //send image and shifts to be displayed on GUI
+    gui.sendImage(MAX_ROWS,MAX_COLS,last,MAX_PIXELS);
+    vectors[0]=filtered_OF[0];
+    vectors[1]=filtered_OF[1];
+    gui.sendVectors(1,1,vectors,1);
+
+    //frames the loop was too busy to take
+    Serial.print("dropped: ");
+    Serial.println(stonyman.getAsyncDropped());
+}
@@ -0,0 +1,207 @@
+/*
+asyncsim.cpp simulates asynchronous Stonyman acquisition on a host computer,
+using a simulated clock and timer interrupt in place of the microcontroller's,
+and the mock Arduino API in place of the chip.  It compares the frame rate of
+reading and then processing each frame with the frame rate of processing one
+frame while the next is read, and checks that every frame handed over is the
+freshest one read, is left intact while it is processed, and is accounted for
+by the count of dropped frames.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <Stonyman.h>
+
+#include <stdio.h>
+
+static const uint8_t  ROWS = 16;
+static const uint8_t  COLS = 16;
+
+// Simulated timer period (one pixel per tick), and time to process (flow +
+// telemetry) one frame, in microseconds
+static const uint32_t TIMER_USEC = 20;
+static const uint32_t FRAME_USEC = 3000;
+
+static const uint16_t FRAMES = 100;
+
+static uint16_t buf1[ROWS*COLS];
+static uint16_t buf2[ROWS*COLS];
+
+// Simulated clock and timer interrupt
+static uint32_t clock_usec;
+static uint32_t next_tick;
+static bool     timer_enabled;
+
+// Frames read, and the checksums of the two buffers when the last one was read
+static uint32_t pixels_read;
+static uint32_t frames_read;
+static uint32_t sums[2];
+static uint32_t freshest;
+
+static uint32_t failures;
+
+static Stonyman stonyman(3, 4, 5, 8);
+
+static uint32_t checksum(const uint16_t * frame)
+{
+    uint32_t sum = 0;
+    for (uint16_t k=0; k<ROWS*COLS; ++k)
+        sum = (sum << 5 | sum >> 27) ^ frame[k];
+    return sum;
+}
+
+static void fail(const char * what)
+{
+    printf("FAILED: %s\n", what);
+    failures++;
+}
+
+// Reads one pixel, and at the end of each frame notes the checksum of the
+// buffer that changed, which holds the frame just read
+static void step(void)
+{
+    stonyman.stepAsync();
+
+    if (++pixels_read % (ROWS*COLS))
+        return;
+
+    frames_read++;
+
+    uint32_t sum1 = checksum(buf1);
+    uint32_t sum2 = checksum(buf2);
+    freshest = sum1 != sums[0] ? sum1 : sum2;
+    sums[0] = sum1;
+    sums[1] = sum2;
+}
+
+// Lets simulated time pass, calling the "interrupt service routine" on each
+// timer tick, as the microcontroller would while the loop runs
+static void run(uint32_t usec)
+{
+    uint32_t end = clock_usec + usec;
+
+    while (next_tick <= end) {
+        clock_usec = next_tick;
+        if (timer_enabled)
+            step();
+        next_tick += TIMER_USEC;
+    }
+
+    clock_usec = end;
+}
+
+// Waits for a frame, stepping the readout ourselves if the timer is disabled
+static uint16_t * wait_frame(void)
+{
+    uint16_t * frame;
+
+    while (!(frame = stonyman.getAsyncFrame())) {
+        if (timer_enabled)
+            run(1);
+        else {
+            run(TIMER_USEC);
+            step();
+        }
+    }
+
+    return frame;
+}
+
+// Processes the frame where it lies, checking that it is the freshest one and
+// that it does not change until we release it, then waits before polling again
+static void process(uint16_t * frame, uint32_t usec, uint32_t idle_usec)
+{
+    uint32_t sum = checksum(frame);
+
+    if (frame != buf1 && frame != buf2)
+        fail("frame outside the buffers");
+
+    if (sum != freshest)
+        fail("stale frame handed over");
+
+    if (stonyman.getAsyncFrame() != frame)
+        fail("frame not held until released");
+
+    run(usec);
+
+    if (checksum(frame) != sum)
+        fail("frame overwritten while held");
+
+    stonyman.releaseAsyncFrame();
+
+    run(idle_usec);
+}
+
+// Returns the frame rate, checking that every frame read was either processed,
+// dropped, or is still waiting to be taken
+static double measure(bool async, uint32_t usec, uint32_t idle_usec, uint32_t * dropped)
+{
+    ImageBounds bounds(24, ROWS, 4, 24, COLS, 4);
+
+    stonyman.startAsync(buf1, buf2, 0, bounds);
+
+    clock_usec = 0;
+    next_tick = TIMER_USEC;
+    timer_enabled = async;
+    pixels_read = 0;
+    frames_read = 0;
+    sums[0] = checksum(buf1);
+    sums[1] = checksum(buf2);
+
+    for (uint16_t k=0; k<FRAMES; ++k)
+        process(wait_frame(), usec, idle_usec);
+
+    *dropped = stonyman.getAsyncDropped();
+
+    uint32_t waiting = stonyman.getAsyncFrame() ? 1 : 0;
+
+    stonyman.stopAsync();
+
+    if (FRAMES + *dropped + waiting != frames_read)
+        fail("frames read not accounted for");
+
+    return FRAMES / (clock_usec / 1e6);
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    stonyman.begin();
+
+    uint32_t dropped = 0;
+
+    double serial = measure(false, FRAME_USEC, 0, &dropped);
+    if (dropped)
+        fail("frames dropped by serial readout");
+
+    printf("readout only: %6.1f frames/sec\n", 1e6 / ((uint32_t)TIMER_USEC * ROWS * COLS));
+    printf("serial:       %6.1f frames/sec\n", serial);
+
+    // processing faster than the readout should drop nothing
+    double async = measure(true, FRAME_USEC, 0, &dropped);
+    printf("asynchronous: %6.1f frames/sec (%u dropped)\n", async, (unsigned)dropped);
+    if (dropped)
+        fail("frames dropped by asynchronous readout");
+
+    // processing slower than the readout drops the frames read while it runs
+    async = measure(true, 3*FRAME_USEC, 0, &dropped);
+    printf("slow process: %6.1f frames/sec (%u dropped)\n", async, (unsigned)dropped);
+    if (!dropped)
+        fail("no frames dropped by slow processing");
+
+    // polling slower than the readout replaces the frames not yet taken
+    async = measure(true, FRAME_USEC/3, 4*FRAME_USEC, &dropped);
+    printf("slow polling: %6.1f frames/sec (%u dropped)\n", async, (unsigned)dropped);
+    if (!dropped)
+        fail("no frames replaced by slow polling");
+
+    if (failures) {
+        printf("%u FAILED\n", (unsigned)failures);
+        return 1;
+    }
+
+    printf("all frames fresh, intact, and accounted for\n");
+    return 0;
+}
@@ -0,0 +1,400 @@
+/*
+flowbench.cpp times the ImageUtils and OpticalFlow kernels on a host computer,
+for eight- and sixteen-bit pixels, for several image sizes, and for images
+stored either contiguously or as windows of a larger (VGA) frame, so that each
+row is followed by a gap.  The results are printed as JSON, one record per
+kernel, type, size and layout, giving the time per call, the time per pixel,
+the throughput, and the CPU cycles per pixel, counted with perf_event where
+the kernel allows it, or with the time-stamp counter on x86.
+
+Usage: flowbench [FILTER [SECONDS]]
+
+FILTER, if given, runs only the kernels whose names contain it; SECONDS is the
+shortest time for one measurement (default 0.01).
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <OpticalFlow.h>
+#include <ImageUtils.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+static const uint16_t VGA_ROWS = 480;
+static const uint16_t VGA_COLS = 640;
+
+static const uint16_t SIZES[] = {10, 16, 48, 112};
+static const uint8_t  NSIZES = sizeof(SIZES) / sizeof(SIZES[0]);
+static const uint16_t MAXSIZE = 112;
+
+// Each measurement is repeated this many times, keeping the fastest
+static const uint8_t REPEATS = 3;
+
+static const uint16_t SCALE = 100;
+
+static const char * filter = NULL;
+static double min_seconds = 0.01;
+
+static bool first_record = true;
+
+// Outputs of the kernels, kept where the compiler can't throw them away
+static int16_t ofx, ofy;
+static uint32_t confidence;
+static int16_t u[MAXSIZE*MAXSIZE];
+static int16_t v[MAXSIZE*MAXSIZE];
+static int16_t out[MAXSIZE*MAXSIZE];
+static uint16_t out16[MAXSIZE*MAXSIZE];
+static uint16_t lo[MAXSIZE*MAXSIZE];
+static uint16_t hi[MAXSIZE*MAXSIZE];
+static uint8_t census_curr[MAXSIZE*MAXSIZE];
+static uint8_t census_last[MAXSIZE*MAXSIZE];
+static uint8_t mask[MAXSIZE*MAXSIZE];
+static uint16_t mask_base;
+static int16_t phase_work[4*OFO_PHASECORR_MAX*OFO_PHASECORR_MAX];
+static FlowSums<uint32_t> sat[(MAXSIZE+1)*(MAXSIZE+1)];
+static flowsums_t sums;
+
+#ifdef __linux__
+static int perf_fd = -1;
+#endif
+
+// Opens the cycle counter, returning its name
+static const char * cycles_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd >= 0)
+        return "perf";
+#endif
+#ifdef HAVE_RDTSC
+    return "rdtsc";
+#else
+    return "none";
+#endif
+}
+
+static uint64_t cycles(void)
+{
+#ifdef __linux__
+    if (perf_fd >= 0) {
+        uint64_t count = 0;
+        return read(perf_fd, &count, sizeof(count)) == sizeof(count) ? count : 0;
+    }
+#endif
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Times a kernel, given as a function object, and prints its record.  Pixels
+// are those of the whole image, whatever part of it the kernel uses.
+template <typename F>
+static void bench(const char * kernel, const char * type, uint16_t rows, uint16_t cols,
+        const char * layout, uint16_t stride, F f)
+{
+    if (filter && !strstr(kernel, filter))
+        return;
+
+    // Double the calls per measurement until one takes long enough
+    uint32_t calls = 1;
+    for (;;) {
+        double start = seconds();
+        for (uint32_t k=0; k<calls; ++k) {
+            f();
+            __asm__ __volatile__("" ::: "memory");
+        }
+        if (seconds() - start >= min_seconds)
+            break;
+        calls *= 2;
+    }
+
+    double best = 1e30;
+    uint64_t best_cycles = 0;
+
+    for (uint8_t j=0; j<REPEATS; ++j) {
+        double start = seconds();
+        uint64_t cstart = cycles();
+        for (uint32_t k=0; k<calls; ++k) {
+            f();
+            __asm__ __volatile__("" ::: "memory");
+        }
+        uint64_t celapsed = cycles() - cstart;
+        double elapsed = seconds() - start;
+        if (elapsed < best) {
+            best = elapsed;
+            best_cycles = celapsed;
+        }
+    }
+
+    double pixels = (double)calls * rows * cols;
+
+    printf("%s\n    {\"kernel\": \"%s\", \"type\": \"%s\", \"rows\": %u, \"cols\": %u, "
+            "\"layout\": \"%s\", \"stride\": %u, \"ns_per_call\": %.1f, \"ns_per_pixel\": %.3f, "
+            "\"mpix_per_s\": %.1f, \"cycles_per_pixel\": ",
+            first_record ? "" : ",", kernel, type, rows, cols, layout, stride,
+            1e9*best/calls, 1e9*best/pixels, pixels/best/1e6);
+
+    if (best_cycles)
+        printf("%.3f}", best_cycles / pixels);
+    else
+        printf("null}");
+
+    first_record = false;
+}
+
+// Kernels that take only one type of pixel
+static void bench_typed(ImageView<uint16_t> curr, ImageView<uint16_t> last, bool contiguous,
+        const char * layout)
+{
+    const uint16_t R = curr.rows();
+    const uint16_t C = curr.cols();
+    const uint16_t S = curr.stride();
+    const uint16_t N = R * C;
+
+    bench("imgMin", "uint16_t", R, C, layout, S, [&]() { out16[0] = imgMin(curr); });
+    bench("imgMax", "uint16_t", R, C, layout, S, [&]() { out16[0] = imgMax(curr); });
+    bench("imgSubwin2Dto1DHorizontal", "uint16_t", R, C, layout, S,
+            [&]() { imgSubwin2Dto1DHorizontal(curr, out16); });
+    bench("imgSubwin2Dto1DVertical", "uint16_t", R, C, layout, S,
+            [&]() { imgSubwin2Dto1DVertical(curr, out16); });
+
+    if (!contiguous)
+        return;
+
+    uint16_t * pcurr = curr.pixels();
+    uint16_t * plast = last.pixels();
+
+    bench("imgDiff", "uint16_t", R, C, layout, S, [&]() { imgDiff(pcurr, plast, out16, N); });
+    bench("imgFilter", "uint16_t", R, C, layout, S,
+            [&]() { imgFilter(pcurr, lo, hi, N, 3); });
+    bench("imgCalcMask", "uint16_t", R, C, layout, S,
+            [&]() { imgCalcMask(pcurr, N, mask, &mask_base); });
+
+    // These change the image, so they work on a copy
+    imgCopy(pcurr, out16, N);
+    bench("imgApplyMask", "uint16_t", R, C, layout, S,
+            [&]() { imgApplyMask(out16, N, mask, mask_base); });
+    bench("imgAddFpn", "uint16_t", R, C, layout, S, [&]() { imgAddFpn(out16, mask, N); });
+}
+
+static void bench_typed(ImageView<uint8_t> curr, ImageView<uint8_t> last, bool contiguous,
+        const char * layout)
+{
+    const uint16_t R = curr.rows();
+    const uint16_t C = curr.cols();
+
+    if (contiguous)
+        bench("ofoIIA_1D", "uint8_t", R, C, layout, C,
+                [&]() { ofoIIA_1D(curr.pixels(), last.pixels(), R*C, SCALE, out); });
+}
+
+template <typename P, uint8_t BITS>
+static void bench_view(ImageView<P> curr, ImageView<P> last, bool contiguous, const char * type)
+{
+    const uint16_t R = curr.rows();
+    const uint16_t C = curr.cols();
+    const uint16_t S = curr.stride();
+    const uint16_t N = R * C;
+    const char * layout = contiguous ? "contiguous" : "strided";
+
+    bench("imgCopy(ImageView)", type, R, C, layout, S, [&]() { imgCopy(curr, (P *)out16); });
+
+    bench("ofoSums_Plus_2D", type, R, C, layout, S, [&]() { ofoSums_Plus_2D<P,BITS>(curr, last, &sums); });
+    bench("ofoSums_Square_2D", type, R, C, layout, S, [&]() { ofoSums_Square_2D<P,BITS>(curr, last, &sums); });
+    bench("ofoIIA_Plus_2D", type, R, C, layout, S,
+            [&]() { ofoIIA_Plus_2D<P,BITS>(curr, last, SCALE, &ofx, &ofy); });
+    bench("ofoIIA_Square_2D", type, R, C, layout, S,
+            [&]() { ofoIIA_Square_2D<P,BITS>(curr, last, SCALE, &ofx, &ofy); });
+    bench("ofoLK_Plus_2D", type, R, C, layout, S,
+            [&]() { ofoLK_Plus_2D<P,BITS>(curr, last, SCALE, &ofx, &ofy); });
+    bench("ofoLK_Square_2D", type, R, C, layout, S,
+            [&]() { ofoLK_Square_2D<P,BITS>(curr, last, SCALE, &ofx, &ofy); });
+    bench("ofoLK_Square_2D+confidence", type, R, C, layout, S,
+            [&]() { ofoLK_Square_2D<P,BITS>(curr, last, SCALE, &ofx, &ofy, 1, &confidence); });
+
+    bench("ofoIntegral_2D", type, R, C, layout, S,
+            [&]() { ofoIntegral_2D(curr, last, OFO_LK_SQUARE, sat); });
+    uint16_t patch = (R < C ? R : C) / 2;
+    bench("ofoLK_Grid", type, R, C, layout, S,
+            [&]() { ofoLK_Grid(sat, R, C, OFO_LK_SQUARE, patch, patch/2, SCALE, u, v); });
+
+    bench("ofoCensus_2D", type, R, C, layout, S, [&]() { ofoCensus_2D(curr, census_curr); });
+    ofoCensus_2D(last, census_last);
+    if (contiguous)
+        bench("ofoHamming_2D", "uint8_t", R, C, layout, S,
+                [&]() { ofoHamming_2D(census_curr, census_last, R, C, 2, SCALE, &ofx, &ofy); });
+
+    bench("ofoBlockMatch_2D", type, R, C, layout, S,
+            [&]() { ofx = ofy = 0; ofoBlockMatch_2D(curr, last, 2, 2, R-4, 2, SCALE, &ofx, &ofy); });
+
+    uint8_t n = OFO_PHASECORR_MAX;
+    while (n > R || n > C)
+        n /= 2;
+    bench("ofoPhaseCorr_2D", type, R, C, layout, S,
+            [&]() { ofoPhaseCorr_2D(curr, last, n, phase_work, SCALE, &ofx, &ofy); });
+
+    memset(u, 0, sizeof(u));
+    memset(v, 0, sizeof(v));
+    bench("ofoHornSchunck_2D", type, R, C, layout, S,
+            [&]() { ofoHornSchunck_2D(curr, last, 64, 4, u, v); });
+
+    // Each row is a 1D image
+    bench("ofoIIA_1D_Batch", type, R, C, layout, S,
+            [&]() { ofoIIA_1D_Batch<P,BITS>(curr.pixels(), last.pixels(), C, 1, R, S, SCALE, out); });
+
+    bench_typed(curr, last, contiguous, layout);
+
+    if (!contiguous)
+        return;
+
+    P * pcurr = curr.pixels();
+    P * plast = last.pixels();
+
+    static P work[ofoPyramidWorkSize(MAXSIZE, MAXSIZE, 3)];
+
+    bench("imgCopy", type, R, C, layout, S, [&]() { imgCopy(pcurr, (P *)out16, N); });
+    bench("imgDownsample2x2", type, R, C, layout, S,
+            [&]() { imgDownsample2x2(pcurr, R, C, (P *)out16); });
+    bench("imgWarpBilinear", type, R, C, layout, S,
+            [&]() { imgWarpBilinear(pcurr, R, C, 96, -160, (P *)out16); });
+    bench("ofoLK_Pyramid", type, R, C, layout, S,
+            [&]() { ofoLK_Pyramid<P,BITS>(pcurr, plast, R, C, 3, 2, work, SCALE, &ofx, &ofy); });
+}
+
+// Fills a frame with a smooth texture, shifted by a fraction of a pixel
+static void texture(double * frame, double dx, double dy)
+{
+    for (uint16_t r=0; r<VGA_ROWS; ++r)
+        for (uint16_t c=0; c<VGA_COLS; ++c) {
+            double x = c - dx;
+            double y = r - dy;
+            frame[r*VGA_COLS+c] = 0.5 + 0.25*sin(0.31*x + 0.05*y) + 0.2*cos(0.23*y - 0.11*x);
+        }
+}
+
+template <typename P, uint8_t BITS>
+static void bench_type(const char * type, const double * curr_frame, const double * last_frame)
+{
+    const uint32_t FRAMESIZE = (uint32_t)VGA_ROWS * VGA_COLS;
+
+    P * curr = new P[FRAMESIZE];
+    P * last = new P[FRAMESIZE];
+
+    // pixels spanning BITS bits, e.g. ten for the Arduino ADC
+    const uint16_t maxval = (uint16_t)((1UL << BITS) - 1);
+
+    for (uint32_t k=0; k<FRAMESIZE; ++k) {
+        curr[k] = (P)(curr_frame[k] * maxval);
+        last[k] = (P)(last_frame[k] * maxval);
+    }
+
+    static P curr_patch[MAXSIZE*MAXSIZE];
+    static P last_patch[MAXSIZE*MAXSIZE];
+
+    for (uint8_t k=0; k<NSIZES; ++k) {
+
+        uint16_t size = SIZES[k];
+
+        // A window at the center of the frame
+        ImageView<P> curr_win = ImageView<P>(curr, VGA_ROWS, VGA_COLS).window(
+                (VGA_ROWS-size)/2, (VGA_COLS-size)/2, size, size);
+        ImageView<P> last_win = ImageView<P>(last, VGA_ROWS, VGA_COLS).window(
+                (VGA_ROWS-size)/2, (VGA_COLS-size)/2, size, size);
+
+        // The same window, copied to contiguous images
+        imgCopy(curr_win, curr_patch);
+        imgCopy(last_win, last_patch);
+
+        bench_view<P,BITS>(ImageView<P>(curr_patch, size, size), ImageView<P>(last_patch, size, size), true, type);
+        bench_view<P,BITS>(curr_win, last_win, false, type);
+    }
+
+    delete[] curr;
+    delete[] last;
+}
+
+// Flow filters work on flow values rather than pixels
+static void bench_filters(void)
+{
+    static int16_t stage[MAXSIZE*MAXSIZE];
+
+    for (uint32_t k=0; k<MAXSIZE*MAXSIZE; ++k)
+        out[k] = (int16_t)(k * 37);
+
+    for (uint8_t k=0; k<NSIZES; ++k) {
+
+        uint16_t size = SIZES[k];
+        uint16_t n = size * size;
+
+        bench("ofoLPF_Q15", "int16_t", size, size, "contiguous", size,
+                [&]() { ofoLPF_Q15(u, out, n, ofoAlphaQ15(0.35)); });
+        bench("ofoLPF_Shift", "int16_t", size, size, "contiguous", size,
+                [&]() { ofoLPF_Shift(u, out, n, 2); });
+        bench("ofoLPF2_Q15", "int16_t", size, size, "contiguous", size,
+                [&]() { ofoLPF2_Q15(stage, u, out, n, ofoAlphaQ15(0.35)); });
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc > 1)
+        filter = argv[1];
+
+    if (argc > 2)
+        min_seconds = atof(argv[2]);
+
+    const char * counter = cycles_open();
+
+    const uint32_t FRAMESIZE = (uint32_t)VGA_ROWS * VGA_COLS;
+
+    double * curr_frame = new double[FRAMESIZE];
+    double * last_frame = new double[FRAMESIZE];
+
+    texture(last_frame, 0, 0);
+    texture(curr_frame, 0.6, -0.4);
+
+    printf("{\n\"frame\": {\"rows\": %u, \"cols\": %u},\n\"cycles\": \"%s\",\n\"results\": [",
+            VGA_ROWS, VGA_COLS, counter);
+
+    bench_type<uint8_t, 8>("uint8_t", curr_frame, last_frame);
+    bench_type<uint16_t, 10>("uint16_t", curr_frame, last_frame);
+    bench_filters();
+
+    printf("\n]\n}\n");
+
+    delete[] curr_frame;
+    delete[] last_frame;
+
+    return 0;
+}
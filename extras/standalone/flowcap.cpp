@@ -71,8 +71,6 @@ int main(int argc, char** argv)
 
     // Set up patches for optical flow
     int patchsize = frame.cols / IMAGE_SCALEDOWN / PATCHES_PER_ROW;
-    cv::Mat currpatch;
-    cv::Mat prevpatch;
 
     while (true) {
 
@@ -98,18 +96,18 @@ int main(int argc, char** argv)
         // Compute and display optical flow when previous image available
         if (!prev.empty()) {
 
-            for (int row=0; row<curr.rows; row+=patchsize) {
+            // View the images in place, so patches need not be copied
+            ImageView<uint8_t> currview(curr.data, curr.rows, curr.cols, curr.step);
+            ImageView<uint8_t> prevview(prev.data, prev.rows, prev.cols, prev.step);
 
-                for (int col=0; col<curr.cols; col+=patchsize) {
+            for (int row=0; row+patchsize<=curr.rows; row+=patchsize) {
 
-                    // Copy a patch from the current and previous images
-                    cv::Rect rect(col, row, patchsize, patchsize);
-                    curr(rect).copyTo(currpatch);
-                    prev(rect).copyTo(prevpatch);
+                for (int col=0; col+patchsize<=curr.cols; col+=patchsize) {
 
-                    // Compute optical flow on the patches
+                    // Compute optical flow on a patch of the current and previous images
                     int16_t ofx=0, ofy=0;
-                    ofoLK_Square_2D(currpatch.data, prevpatch.data, patchsize, patchsize, FLOWSCALE, &ofx, &ofy);
+                    ofoLK_Square_2D(currview.window(row, col, patchsize, patchsize), 
+                                    prevview.window(row, col, patchsize, patchsize), FLOWSCALE, &ofx, &ofy);
 
                     // Display the patch in the full-size pixellated image
                     addFlow(cdisplay, ofx, ofy, col*IMAGE_SCALEDOWN, row*IMAGE_SCALEDOWN);
@@ -123,8 +121,9 @@ int main(int argc, char** argv)
         cv::imshow(windowname, cdisplay);
         if(cv::waitKey(1)  == 27) break; // exit on ESC
 
-        // Current image becomes previous for next iteration
-        curr.copyTo(prev);
+        // Current image becomes previous for next iteration; curr is a new image
+        // each time, so the two can share pixels
+        prev = curr;
 
         // Increment the FPS counter
         count++;
@@ -0,0 +1,321 @@
+/*
+flowcheck.cpp checks the optical flow estimators on a host computer, on pairs
+of synthetic images whose motion is known: a smooth texture of a few sinusoids,
+and blurred random noise.  Each estimator must recover the motion to within the
+tolerance stated for it below.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <OpticalFlow.h>
+#include <ImageUtils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const uint16_t MAXSIZE = 64;
+
+// Noise is drawn over a field larger than any image, so that images shifted by
+// up to MARGIN pixels stay inside it
+static const uint16_t MARGIN = 16;
+static const uint16_t FIELD  = MAXSIZE + 2*MARGIN;
+
+static double noise[FIELD][FIELD];
+
+static uint32_t failures;
+static uint32_t checked;
+
+static uint32_t state = 2463534242UL;
+
+static uint32_t xorshift(void)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Fills the noise field with random pixels blurred by a Gaussian of two pixels'
+// variance, stretched back to most of the eight-bit range
+static void make_noise(void)
+{
+    static double raw[FIELD][FIELD];
+
+    for (uint16_t i=0; i<FIELD; ++i)
+        for (uint16_t j=0; j<FIELD; ++j)
+            raw[i][j] = xorshift() & 0xFF;
+
+    for (int i=0; i<FIELD; ++i)
+        for (int j=0; j<FIELD; ++j) {
+            double sum = 0, weight = 0;
+            for (int a=-3; a<=3; ++a)
+                for (int b=-3; b<=3; ++b) {
+                    if (i+a < 0 || j+b < 0 || i+a >= FIELD || j+b >= FIELD)
+                        continue;
+                    double g = exp(-(a*a + b*b) / 4.0);
+                    sum += g * raw[i+a][j+b];
+                    weight += g;
+                }
+            double v = 128 + 3 * (sum / weight - 128);
+            noise[i][j] = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+}
+
+// Textures, as brightness from 0 to 255 at a row and column
+static double smooth(double r, double c)
+{
+    return 128 + 50*sin(0.11*c + 0.05*r) + 40*sin(0.09*r - 0.04*c + 1) + 20*sin(0.23*c + 0.19*r + 2);
+}
+
+// Noise between pixels is interpolated bilinearly
+static double blurred(double r, double c)
+{
+    const int i = (int)floor(r);
+    const int j = (int)floor(c);
+    const double a = r - i;
+    const double b = c - j;
+
+    const double * n0 = noise[i + MARGIN] + MARGIN;
+    const double * n1 = noise[i + 1 + MARGIN] + MARGIN;
+
+    return (1-a) * ((1-b) * n0[j] + b * n0[j+1]) + a * ((1-b) * n1[j] + b * n1[j+1]);
+}
+
+typedef double (*texture_t)(double r, double c);
+
+static const uint8_t TEXTURES = 2;
+static const texture_t textures[TEXTURES] = {smooth, blurred};
+static const char * texture_names[TEXTURES] = {"smooth", "noise"};
+
+// Fills an image with a texture moved by (dx, dy) pixels, scaled to the pixel type:
+// img(r, c) = texture(r - dy, c - dx)
+template <typename P>
+static void render(P * img, uint16_t rows, uint16_t cols, texture_t texture, double dx, double dy, uint8_t bits)
+{
+    for (uint16_t r=0; r<rows; ++r)
+        for (uint16_t c=0; c<cols; ++c)
+            img[r*cols+c] = (P)(texture(r - dy, c - dx) * (1 << (bits-8)));
+}
+
+static void report(bool ok, const char * what, const char * detail)
+{
+    checked++;
+
+    if (ok)
+        return;
+
+    if (failures < 20)
+        printf("FAILED %s: %s\n", what, detail);
+
+    failures++;
+}
+
+// Checks a shift against the motion, given the shift for a pixel of motion: with
+// a scale of 256, -128 for Lucas-Kanade and -256 for image interpolation
+static void check_shift(const char * what, const char * texture, double dx, double dy,
+        int16_t ofx, int16_t ofy, int16_t perpixel, int16_t tolerance)
+{
+    const int16_t wantx = (int16_t)lround(perpixel * dx);
+    const int16_t wanty = (int16_t)lround(perpixel * dy);
+
+    char detail[100];
+    snprintf(detail, sizeof(detail), "%s moved (%g,%g): got (%d,%d), want (%d,%d)",
+            texture, dx, dy, ofx, ofy, wantx, wanty);
+
+    report(abs(ofx - wantx) <= tolerance && abs(ofy - wanty) <= tolerance, what, detail);
+}
+
+// Pyramid: every integer motion of up to six pixels in each direction on 64x64
+// images with four levels, and up to three pixels on 32x32 images with three;
+// within a quarter pixel
+template <typename P, uint8_t BITS>
+static void check_pyramid(void)
+{
+    static P curr[MAXSIZE*MAXSIZE];
+    static P last[MAXSIZE*MAXSIZE];
+    static P work[ofoPyramidWorkSize(MAXSIZE, MAXSIZE, 4)];
+
+    for (uint8_t t=0; t<TEXTURES; ++t) {
+        for (uint16_t size=32; size<=64; size*=2) {
+
+            const int reach = size == 64 ? 6 : 3;
+            const uint8_t levels = size == 64 ? 4 : 3;
+
+            for (int dy=-reach; dy<=reach; ++dy)
+                for (int dx=-reach; dx<=reach; ++dx) {
+                    render(last, size, size, textures[t], 0, 0, BITS);
+                    render(curr, size, size, textures[t], dx, dy, BITS);
+                    int16_t ofx, ofy;
+                    ofoLK_Pyramid<P,BITS>(curr, last, size, size, levels, 4, work, 256, &ofx, &ofy);
+                    check_shift("ofoLK_Pyramid", texture_names[t], dx, dy, ofx, ofy, -128, 32);
+                }
+        }
+    }
+}
+
+// Phase correlation: every integer motion of up to a fifth of the window in each
+// direction, for 16x16 and 32x32 windows of 64x64 images of noise; within a quarter 
+// pixel.  The smooth texture varies too little within such windows.
+template <typename P, uint8_t BITS>
+static void check_phasecorr(void)
+{
+    static P curr[MAXSIZE*MAXSIZE];
+    static P last[MAXSIZE*MAXSIZE];
+    static int16_t work[4*32*32];
+
+    for (uint8_t n=16; n<=32; n*=2) {
+
+        const int reach = n / 5;
+
+        for (int dy=-reach; dy<=reach; ++dy)
+            for (int dx=-reach; dx<=reach; ++dx) {
+                render(last, MAXSIZE, MAXSIZE, blurred, 0, 0, BITS);
+                render(curr, MAXSIZE, MAXSIZE, blurred, dx, dy, BITS);
+                int16_t ofx, ofy;
+                bool ok = ofoPhaseCorr_2D(ImageView<P>(curr, MAXSIZE, MAXSIZE), 
+                        ImageView<P>(last, MAXSIZE, MAXSIZE), n, work, 256, &ofx, &ofy);
+                report(ok, "ofoPhaseCorr_2D", "window size rejected");
+                check_shift("ofoPhaseCorr_2D", "noise", dx, dy, ofx, ofy, -256, 64);
+            }
+    }
+}
+
+// Horn-Schunck: the mean field over the interior of 32x32 images moved by half a 
+// pixel in each direction, after many sweeps from zero; within a quarter pixel.  A
+// whole pixel is too far for its linearization on the noise: the mean then falls 
+// short by up to a quarter pixel however the weight and sweeps are chosen.
+template <typename P, uint8_t BITS>
+static void check_hornschunck(void)
+{
+    static const uint16_t SIZE = 32;
+    static const uint16_t BORDER = 4;
+
+    static P curr[SIZE*SIZE];
+    static P last[SIZE*SIZE];
+    static int16_t u[SIZE*SIZE];
+    static int16_t v[SIZE*SIZE];
+
+    // a squared differential of a twentieth of the pixel range
+    const uint32_t alpha2 = (uint32_t)(12 << (BITS-8)) * (12 << (BITS-8));
+
+    for (uint8_t t=0; t<TEXTURES; ++t)
+        for (double dy=-0.5; dy<=0.5; dy+=0.5)
+            for (double dx=-0.5; dx<=0.5; dx+=0.5) {
+                render(last, SIZE, SIZE, textures[t], 0, 0, BITS);
+                render(curr, SIZE, SIZE, textures[t], dx, dy, BITS);
+                memset(u, 0, sizeof(u));
+                memset(v, 0, sizeof(v));
+                ofoHornSchunck_2D(ImageView<P>(curr, SIZE, SIZE), ImageView<P>(last, SIZE, SIZE), 
+                        alpha2, 200, u, v);
+                int32_t sumx = 0, sumy = 0;
+                for (uint16_t r=BORDER; r<SIZE-BORDER; ++r)
+                    for (uint16_t c=BORDER; c<SIZE-BORDER; ++c) {
+                        sumx += u[r*SIZE+c];
+                        sumy += v[r*SIZE+c];
+                    }
+                const int32_t count = (SIZE-2*BORDER) * (SIZE-2*BORDER);
+                check_shift("ofoHornSchunck_2D", texture_names[t], dx, dy, 
+                        (int16_t)(sumx/count), (int16_t)(sumy/count), -256, 64);
+            }
+}
+
+// Census: every integer motion within a search range of four pixels in each 
+// direction, on 32x32 images of both textures; within a quarter pixel
+template <typename P, uint8_t BITS>
+static void check_hamming(void)
+{
+    static const uint16_t SIZE = 32;
+    static const uint8_t RANGE = 4;
+
+    static P curr[SIZE*SIZE];
+    static P last[SIZE*SIZE];
+    static uint8_t curr_census[SIZE*SIZE];
+    static uint8_t last_census[SIZE*SIZE];
+
+    for (uint8_t t=0; t<TEXTURES; ++t)
+        for (int dy=-RANGE; dy<=RANGE; ++dy)
+            for (int dx=-RANGE; dx<=RANGE; ++dx) {
+                render(last, SIZE, SIZE, textures[t], 0, 0, BITS);
+                render(curr, SIZE, SIZE, textures[t], dx, dy, BITS);
+                ofoCensus_2D(curr, SIZE, SIZE, curr_census);
+                ofoCensus_2D(last, SIZE, SIZE, last_census);
+                int16_t ofx, ofy;
+                ofoHamming_2D(curr_census, last_census, SIZE, SIZE, RANGE, 256, &ofx, &ofy);
+                check_shift("ofoHamming_2D", texture_names[t], dx, dy, ofx, ofy, -256, 64);
+            }
+}
+
+// Block matching: every integer motion of up to six pixels in each direction for 
+// a 16x16 block at the center of 64x64 images, searched from no prediction, and 
+// motions of twelve pixels searched from a prediction three pixels off; within a
+// quarter pixel
+template <typename P, uint8_t BITS>
+static void check_blockmatch(void)
+{
+    static const uint16_t BLOCK = 16;
+    static const uint16_t CORNER = (MAXSIZE - BLOCK) / 2;
+
+    static P curr[MAXSIZE*MAXSIZE];
+    static P last[MAXSIZE*MAXSIZE];
+
+    static const int REACH = 6;
+    static const int FAR = 12;
+
+    for (uint8_t t=0; t<TEXTURES; ++t) {
+
+        for (int dy=-REACH; dy<=REACH; ++dy)
+            for (int dx=-REACH; dx<=REACH; ++dx) {
+                render(last, MAXSIZE, MAXSIZE, textures[t], 0, 0, BITS);
+                render(curr, MAXSIZE, MAXSIZE, textures[t], dx, dy, BITS);
+                int16_t ofx = 0, ofy = 0;
+                bool ok = ofoBlockMatch_2D(ImageView<P>(curr, MAXSIZE, MAXSIZE), 
+                        ImageView<P>(last, MAXSIZE, MAXSIZE), CORNER, CORNER, BLOCK, REACH, 256, &ofx, &ofy);
+                report(ok, "ofoBlockMatch_2D", "no candidate in range");
+                check_shift("ofoBlockMatch_2D", texture_names[t], dx, dy, ofx, ofy, -256, 64);
+            }
+
+        for (int dy=-FAR; dy<=FAR; dy+=FAR)
+            for (int dx=-FAR; dx<=FAR; dx+=FAR) {
+                render(last, MAXSIZE, MAXSIZE, textures[t], 0, 0, BITS);
+                render(curr, MAXSIZE, MAXSIZE, textures[t], dx, dy, BITS);
+                // predicted motion three pixels short in each direction
+                const int px = dx > 0 ? dx - 3 : dx < 0 ? dx + 3 : 0;
+                const int py = dy > 0 ? dy - 3 : dy < 0 ? dy + 3 : 0;
+                int16_t ofx = (int16_t)(-256 * px);
+                int16_t ofy = (int16_t)(-256 * py);
+                bool ok = ofoBlockMatch_2D(ImageView<P>(curr, MAXSIZE, MAXSIZE), 
+                        ImageView<P>(last, MAXSIZE, MAXSIZE), CORNER, CORNER, BLOCK, 4, 256, &ofx, &ofy);
+                report(ok, "ofoBlockMatch_2D", "no candidate in range");
+                check_shift("ofoBlockMatch_2D", texture_names[t], dx, dy, ofx, ofy, -256, 64);
+            }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    make_noise();
+
+    check_pyramid<uint8_t,8>();
+    check_pyramid<uint16_t,10>();
+    check_phasecorr<uint8_t,8>();
+    check_phasecorr<uint16_t,10>();
+    check_hornschunck<uint8_t,8>();
+    check_hornschunck<uint16_t,10>();
+    check_hamming<uint8_t,8>();
+    check_hamming<uint16_t,10>();
+    check_blockmatch<uint8_t,8>();
+    check_blockmatch<uint16_t,10>();
+
+    if (failures) {
+        printf("%lu of %lu FAILED\n", (unsigned long)failures, (unsigned long)checked);
+        return 1;
+    }
+
+    printf("%lu motions recovered\n", (unsigned long)checked);
+    return 0;
+}
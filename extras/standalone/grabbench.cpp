@@ -0,0 +1,227 @@
+/*
+grabbench.cpp compares the cost of reading Stonyman frames through the
+FrameGrabber virtual-function interface with the cost of reading them
+through the templated Stonyman::processFrame(), using a mock ADC, and with
+the cost of reading them through the StonymanUtils functions themselves.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <Stonyman.h>
+#include <StonymanUtils.h>
+
+#include <stdio.h>
+#include <time.h>
+
+static const uint16_t FRAMES = 400;
+static const uint8_t  TRIALS = 7;
+
+// These are copies of the private grabbers in StonymanUtils.cpp, kept in step with
+// them, so that each can be passed both by its own type and by its base class.
+// Array and row-sum grabbers read each row into a buffer; the max grabber, and the 
+// row-sum grabber without a buffer, handle each pixel.
+
+class ArrayGrabber final : public FrameGrabber {
+
+    friend class Stonyman;
+
+    uint16_t _img[112*112];
+    uint16_t * _pimg;
+
+    protected:
+
+    virtual void preProcess(void) override
+    {
+        _pimg = _img;
+    }
+
+    virtual uint16_t * getRowBuffer(void) override
+    {
+        return _pimg;
+    }
+
+    virtual void handleRow(uint8_t row, const uint16_t * pixels, uint8_t n) override
+    {
+        (void)row;
+        (void)pixels;
+
+        _pimg += n;
+    }
+};
+
+class SumGrabber final : public FrameGrabber {
+
+    friend class Stonyman;
+
+    uint16_t _sums[112];
+    uint16_t * _psum;
+    uint16_t * _rowbuf;
+    uint32_t _total;
+
+    protected:
+
+    virtual void preProcess(void) override
+    {
+        _psum = _sums;
+    }
+
+    virtual uint16_t * getRowBuffer(void) override
+    {
+        return _rowbuf;
+    }
+
+    virtual void handleVectorStart(void) override
+    {
+        _total = 0;
+    }
+
+    virtual void handlePixel(uint8_t row, uint8_t col, uint16_t pixel, bool use_amp) override
+    {
+        (void)row;
+        (void)col;
+        (void)use_amp;
+
+        _total += pixel;
+    }
+
+    virtual void handleRow(uint8_t row, const uint16_t * pixels, uint8_t n) override
+    {
+        (void)row;
+
+        for (uint8_t i=0; i<n; ++i)
+            _total += pixels[i];
+    }
+
+    virtual void handleVectorEnd(void) override
+    {
+        *_psum++ = _total>>4;
+    }
+
+    public:
+
+    SumGrabber(uint16_t * rowbuf=NULL) : _rowbuf(rowbuf) { }
+};
+
+class MaxGrabber final : public FrameGrabber {
+
+    friend class Stonyman;
+
+    uint16_t _minval;
+    uint16_t _maxval;
+
+    protected:
+
+    virtual void preProcess(void) override
+    {
+        _maxval = 5000;
+        _minval = 0;
+        bestrow = 0;
+        bestcol = 0;
+    }
+
+    virtual void handlePixel(uint8_t row, uint8_t col, uint16_t pixel, bool use_amp) override
+    {
+        if (use_amp) {
+            if (pixel > _minval) {
+                bestrow = row;
+                bestcol = col;
+                _minval = pixel;
+            }
+        }
+        else {
+            if (pixel < _maxval) {
+                bestrow = row;
+                bestcol = col;
+                _maxval = pixel;
+            }
+        }
+    }
+
+    public:
+
+    uint16_t bestrow;
+    uint16_t bestcol;
+};
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Times a number of frames read by a function, in nanoseconds per pixel
+template <typename F>
+static double time_frames(F read)
+{
+    double start = seconds();
+    for (uint16_t k=0; k<FRAMES; ++k)
+        read();
+    return 1e9 * (seconds() - start) / ((uint32_t)FRAMES * 112 * 112);
+}
+
+static double median(double * x)
+{
+    // insertion sort of a few values
+    for (uint8_t i=1; i<TRIALS; ++i)
+        for (uint8_t j=i; j>0 && x[j] < x[j-1]; --j) {
+            double t = x[j];
+            x[j] = x[j-1];
+            x[j-1] = t;
+        }
+    return x[TRIALS/2];
+}
+
+// Reads frames through a copy of a library grabber, passed by its base class
+// (virtual dispatch) and by its own type (static dispatch), and through the
+// library function that uses the grabber itself; the three are interleaved over 
+// several trials, and the median of each is reported
+template <class Grabber, typename F>
+static void run(Stonyman & stonyman, Grabber & grabber, const char * name, F library)
+{
+    ImageBounds bounds;
+
+    double tvirtual[TRIALS], tstatic[TRIALS], tlibrary[TRIALS], speedup[TRIALS];
+
+    for (uint8_t k=0; k<TRIALS; ++k) {
+        tvirtual[k] = time_frames([&]() { stonyman.processFrame((FrameGrabber &)grabber, 0, bounds); });
+        tstatic[k]  = time_frames([&]() { stonyman.processFrame(grabber, 0, bounds); });
+        tlibrary[k] = time_frames(library);
+        speedup[k]  = tvirtual[k] / tstatic[k];
+    }
+
+    printf("%-10s virtual: %6.2f   static: %6.2f   library: %6.2f ns/pixel   speedup: %4.2f\n",
+            name, median(tvirtual), median(tstatic), median(tlibrary), median(speedup));
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    Stonyman stonyman(3, 4, 5, 8);
+    stonyman.begin();
+
+    ImageBounds bounds;
+
+    static uint16_t img[112*112];
+    static uint16_t sums[112];
+    static uint16_t rowbuf[112];
+    uint8_t row, col;
+
+    printf("median of %d trials of %d frames of 112x112 pixels\n", TRIALS, FRAMES);
+
+    static ArrayGrabber array;
+    run(stonyman, array, "array", [&]() { stonymanGetImage(stonyman, img, 0, bounds); });
+
+    static SumGrabber sum(rowbuf);
+    run(stonyman, sum, "sum", [&]() { stonymanGetRowSum(stonyman, sums, rowbuf, 0, bounds); });
+
+    static SumGrabber pixelsum;
+    run(stonyman, pixelsum, "pixel sum", [&]() { stonymanGetRowSum(stonyman, sums, 0, bounds); });
+
+    static MaxGrabber max;
+    run(stonyman, max, "max", [&]() { stonymanFindMax(stonyman, 0, &row, &col, bounds); });
+
+    return 0;
+}
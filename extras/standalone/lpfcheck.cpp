@@ -0,0 +1,130 @@
+/*
+lpfcheck.cpp checks the fixed-point low-pass filters ofoLPF_Q15() and ofoLPF_Shift()
+against the floating-point ofoLPF(), over long runs of random, alternating and 
+full-scale inputs of several ranges, for many values of alpha.  Each output must
+be within the tolerance stated in OpticalFlow.h.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <OpticalFlow.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+static const uint32_t STEPS = 200000;
+
+static uint32_t failures;
+static uint32_t checked;
+
+static uint32_t state = 2463534242UL;
+
+static uint32_t xorshift(void)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Input at a step, between lo and hi: random values, then the two extremes at
+// random, then the extremes alternating slowly, so that the filtered value both
+// wanders and settles
+static int16_t input(uint32_t i, int32_t lo, int32_t hi)
+{
+    switch ((i / 5000) % 3) {
+        case 0:  return (int16_t)(lo + (int32_t)(xorshift() % (uint32_t)(hi - lo + 1)));
+        case 1:  return (int16_t)((xorshift() & 1) ? lo : hi);
+        default: return (int16_t)(((i / 50) & 1) ? lo : hi);
+    }
+}
+
+static void report(bool ok, const char * what, double alpha, int32_t range, int32_t error, int32_t tolerance)
+{
+    checked++;
+
+    if (ok)
+        return;
+
+    if (failures < 20)
+        printf("FAILED %s: alpha %g, input range %ld: off by %ld, tolerance %ld\n", 
+                what, alpha, (long)range, (long)error, (long)tolerance);
+
+    failures++;
+}
+
+// Runs ofoLPF() and ofoLPF_Q15() side by side; they may differ by one count, plus 
+// the rounding error of alpha times the input range over alpha
+static void check_q15(double alpha, int32_t lo, int32_t hi)
+{
+    const uint16_t q = ofoAlphaQ15(alpha);
+    const double dalpha = fabs(q / 32768. - (float)alpha);
+    const int32_t tolerance = 1 + (int32_t)(dalpha * (hi - lo) / alpha);
+
+    int16_t f = 0;
+    int16_t g = 0;
+    int32_t worst = 0;
+
+    for (uint32_t i=0; i<STEPS; ++i) {
+        int16_t x = input(i, lo, hi);
+        ofoLPF(&f, &x, (float)alpha);
+        ofoLPF_Q15(&g, &x, 1, q);
+        int32_t error = abs(f - g);
+        if (error > worst)
+            worst = error;
+    }
+
+    report(worst <= tolerance, "ofoLPF_Q15", alpha, hi - lo, worst, tolerance);
+}
+
+// Runs ofoLPF() and ofoLPF_Shift(), which must agree exactly
+static void check_shift(uint8_t shift, int32_t lo, int32_t hi)
+{
+    const double alpha = 1. / (1 << shift);
+
+    int16_t f = 0;
+    int16_t g = 0;
+    int32_t worst = 0;
+
+    for (uint32_t i=0; i<STEPS; ++i) {
+        int16_t x = input(i, lo, hi);
+        ofoLPF(&f, &x, (float)alpha);
+        ofoLPF_Shift(&g, &x, 1, shift);
+        int32_t error = abs(f - g);
+        if (error > worst)
+            worst = error;
+    }
+
+    report(worst == 0, "ofoLPF_Shift", alpha, hi - lo, worst, 0);
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    static const double alphas[] = {0.01, 0.02, 0.05, 0.1, 0.2, 0.35, 0.5, 0.7, 0.9, 0.99};
+    static const int32_t ranges[] = {100, 1000, 10000, 65535};
+
+    for (uint8_t r=0; r<sizeof(ranges)/sizeof(ranges[0]); ++r) {
+
+        // centered on zero, so that truncation toward zero is checked both ways
+        const int32_t lo = ranges[r] == 65535 ? -32768 : -ranges[r]/2;
+        const int32_t hi = lo + ranges[r];
+
+        for (uint8_t a=0; a<sizeof(alphas)/sizeof(alphas[0]); ++a)
+            check_q15(alphas[a], lo, hi);
+
+        for (uint8_t shift=0; shift<=8; ++shift)
+            check_shift(shift, lo, hi);
+    }
+
+    if (failures) {
+        printf("%lu of %lu FAILED\n", (unsigned long)failures, (unsigned long)checked);
+        return 1;
+    }
+
+    printf("%lu filters within tolerance\n", (unsigned long)checked);
+    return 0;
+}
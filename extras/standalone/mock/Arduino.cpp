@@ -0,0 +1,42 @@
+/*
+Arduino.cpp mock Arduino API for building the ArduEye libraries on a host computer
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <sys/time.h>
+
+HardwareSerial Serial;
+SPIClass SPI;
+
+volatile uint8_t mock_pinvalue;
+
+void (*mock_pinhook)(uint8_t pin, uint8_t value);
+
+uint32_t mock_adcstate = 1;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+unsigned long micros(void)
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return tp.tv_sec * 1000000 + tp.tv_usec;
+}
+
+unsigned long millis(void)
+{
+    return micros() / 1000;
+}
+
+long random(long howbig)
+{
+    return rand() % howbig;
+}
@@ -0,0 +1,90 @@
+/*
+Arduino.h mock Arduino API for building the ArduEye libraries on a host 
+computer.  Pins are ignored, delays return immediately, and analogRead() 
+returns pseudo-random pixel values, so that the cost of the libraries' own 
+code can be measured.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGH   1
+#define LOW    0
+#define INPUT  0
+#define OUTPUT 1
+
+typedef uint8_t byte;
+
+void pinMode(uint8_t pin, uint8_t mode);
+
+// Pin writes, ADC reads and delays are inline, so that timing the libraries
+// measures their own code rather than the overhead of calling the mock
+
+// keeps pin writes from being optimized away
+extern volatile uint8_t mock_pinvalue;
+
+// if set, called on every pin write, e.g. to model the chip in a check program
+extern void (*mock_pinhook)(uint8_t pin, uint8_t value);
+
+// state for the pseudo-random ADC
+extern uint32_t mock_adcstate;
+
+inline void digitalWrite(uint8_t pin, uint8_t value)
+{
+    mock_pinvalue = value;
+
+    if (mock_pinhook)
+        mock_pinhook(pin, value);
+}
+
+inline int analogRead(uint8_t pin)
+{
+    (void)pin;
+
+    // xorshift; return a ten-bit value, as from the Arduino ADC
+    mock_adcstate ^= mock_adcstate << 13;
+    mock_adcstate ^= mock_adcstate >> 17;
+    mock_adcstate ^= mock_adcstate << 5;
+
+    return mock_adcstate & 0x3FF;
+}
+
+inline void delay(unsigned long ms) { (void)ms; }
+inline void delayMicroseconds(unsigned int us) { (void)us; }
+unsigned long millis(void);
+unsigned long micros(void);
+
+long random(long howbig);
+
+// The host has no interrupts to disable
+inline void noInterrupts(void) { }
+inline void interrupts(void) { }
+
+class HardwareSerial {
+
+    public:
+
+        void begin(unsigned long baud) { (void)baud; }
+        int  available(void) { return 0; }
+        int  read(void) { return -1; }
+        void write(uint8_t c) { putchar(c); }
+
+        void print(const char * s) { printf("%s", s); }
+        void print(char c) { putchar(c); }
+        void print(int n) { printf("%d", n); }
+        void print(unsigned int n) { printf("%u", n); }
+        void print(long n) { printf("%ld", n); }
+        void print(unsigned long n) { printf("%lu", n); }
+
+        template <class T>
+        void println(T x) { print(x); putchar('\n'); }
+        void println(void) { putchar('\n'); }
+};
+
+extern HardwareSerial Serial;
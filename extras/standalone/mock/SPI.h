@@ -0,0 +1,18 @@
+/*
+SPI.h mock SPI library for building the ArduEye libraries on a host computer
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+class SPIClass {
+
+    public:
+
+        void begin(void) { }
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,404 @@
+/*
+motioncheck.cpp checks the functions that turn flow into motion of the sensor:
+the Odometry class's displacement, dead band and velocity, against sums and
+rates computed exactly, including across a wraparound of the clock; and 
+ofoEgomotion(), ofoFocusOfExpansion() and ofoTimeToContact() on synthetic grids 
+of flow from known translation, rotation and expansion.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <OpticalFlow.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+static uint32_t failures;
+static uint32_t checked;
+
+static uint32_t state = 2463534242UL;
+
+static uint32_t xorshift(void)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void report(bool ok, const char * what, const char * detail)
+{
+    checked++;
+
+    if (ok)
+        return;
+
+    if (failures < 20)
+        printf("FAILED %s: %s\n", what, detail);
+
+    failures++;
+}
+
+static void check_value(const char * what, int64_t got, int64_t want)
+{
+    char detail[100];
+    snprintf(detail, sizeof(detail), "got %lld, want %lld", (long long)got, (long long)want);
+    report(got == want, what, detail);
+}
+
+// Flows of up to limit in magnitude
+static int16_t random_flow(int16_t limit)
+{
+    return (int16_t)((int32_t)(xorshift() % (2*(uint32_t)limit + 1)) - limit);
+}
+
+// Displacement: random flows through each calibration and dead band must sum to
+// exactly the calibrated flows outside the dead band
+static void check_displacement(void)
+{
+    static const int16_t scales[] = {1 << OFO_QBITS, 3 << (OFO_QBITS-1), -(1 << OFO_QBITS), 77, -1000};
+    static const int16_t deadbands[] = {0, 1, 10, 200};
+
+    for (uint8_t s=0; s<sizeof(scales)/sizeof(scales[0]); ++s)
+        for (uint8_t b=0; b<sizeof(deadbands)/sizeof(deadbands[0]); ++b) {
+
+            const int16_t deadband = deadbands[b];
+
+            Odometry<8> odometry(deadband);
+            odometry.setScale(scales[s], -scales[s]);
+
+            int64_t x = 0;
+            int64_t y = 0;
+            bool agrees = true;
+
+            for (uint16_t k=0; k<1000; ++k) {
+
+                int16_t ofx = random_flow(400);
+                int16_t ofy = random_flow(400);
+
+                bool outx = ofx > deadband || ofx < -deadband;
+                bool outy = ofy > deadband || ofy < -deadband;
+
+                if (outx)
+                    x += (int64_t)ofx * scales[s];
+                if (outy)
+                    y -= (int64_t)ofy * scales[s];
+
+                agrees = agrees && odometry.update(k, ofx, ofy) == (outx || outy);
+            }
+
+            report(agrees, "Odometry::update", "wrong result for dead band");
+
+            // displacements keep OFO_QBITS fractional bits and round down
+            check_value("Odometry::getX", odometry.getX(), x >> OFO_QBITS);
+            check_value("Odometry::getY", odometry.getY(), y >> OFO_QBITS);
+        }
+}
+
+// Dead band: flows up to the dead band on both axes leave the displacement at zero,
+// and a flow just outside it on one axis counts only on that axis
+static void check_deadband(void)
+{
+    const int16_t deadband = 5;
+
+    Odometry<4> odometry(deadband);
+
+    bool still = true;
+    for (int16_t ofy=-deadband; ofy<=deadband; ++ofy)
+        for (int16_t ofx=-deadband; ofx<=deadband; ++ofx)
+            still = still && !odometry.update(0, ofx, ofy);
+
+    report(still, "Odometry::update", "flow within the dead band reported as motion");
+    check_value("Odometry::getX within dead band", odometry.getX(), 0);
+    check_value("Odometry::getY within dead band", odometry.getY(), 0);
+
+    report(odometry.update(0, deadband+1, deadband), "Odometry::update", "flow outside the dead band ignored");
+    report(odometry.update(0, -deadband, -deadband-1), "Odometry::update", "flow outside the dead band ignored");
+    check_value("Odometry::getX outside dead band", odometry.getX(), deadband+1);
+    check_value("Odometry::getY outside dead band", odometry.getY(), -deadband-1);
+
+    // the average of a grid of flows, which is within the dead band though no flow is
+    const int16_t ofx[4] = {20, -20, 30, -28};
+    const int16_t ofy[4] = {-9, 9, 9, -9};
+    report(!odometry.update(0, ofx, ofy, 4), "Odometry::update", "average within the dead band reported as motion");
+    check_value("Odometry::getX of grid", odometry.getX(), deadband+1);
+
+    odometry.reset();
+    check_value("Odometry::getX after reset", odometry.getX(), 0);
+    check_value("Odometry::getCount after reset", odometry.getCount(), 0);
+}
+
+// Velocity: steady flow at a steady frame period, with the clock starting just 
+// before it wraps around, must give the flow over the period over every span of 
+// frames kept, before, across and after the wraparound
+static void check_velocity(void)
+{
+    static const uint32_t periods[] = {1000, 4167, 33333};
+    static const int16_t flows[] = {1, -7, 100, -2000};
+
+    for (uint8_t p=0; p<sizeof(periods)/sizeof(periods[0]); ++p)
+        for (uint8_t f=0; f<sizeof(flows)/sizeof(flows[0]); ++f) {
+
+            Odometry<6> odometry;
+
+            const uint32_t period = periods[p];
+            const int16_t flow = flows[f];
+
+            uint32_t time = 0xFFFFFFFF - 10*period;
+
+            int32_t vx = 12345, vy = 12345;
+            report(!odometry.getVelocity(1, 1000000, &vx, &vy), "Odometry::getVelocity", "velocity with no samples");
+
+            for (uint8_t frame=0; frame<20; ++frame, time += period) {
+
+                odometry.update(time, flow, -flow);
+
+                report(!odometry.getVelocity(0, 1000000, &vx, &vy), "Odometry::getVelocity", "velocity over no frames");
+                report(!odometry.getVelocity(odometry.getCount(), 1000000, &vx, &vy), 
+                        "Odometry::getVelocity", "velocity over more frames than kept");
+
+                for (uint8_t k=1; k<odometry.getCount(); ++k) {
+
+                    vx = vy = 12345;
+
+                    char what[100];
+                    snprintf(what, sizeof(what), "Odometry::getVelocity over %d frames at frame %d, period %lu", 
+                            k, frame, (unsigned long)period);
+
+                    report(odometry.getVelocity(k, 1000000, &vx, &vy), what, "no velocity");
+
+                    // the same truncation toward zero as the class
+                    const int64_t want = (int64_t)flow * (1 << OFO_QBITS) * k * 1000000 / ((int64_t)k * period) / (1 << OFO_QBITS);
+                    check_value(what, vx, want);
+                    check_value(what, vy, -want);
+                }
+            }
+        }
+
+    // no time between the frames
+    Odometry<4> odometry;
+    odometry.update(0xFFFFFFFF, 10, 10);
+    odometry.update(0xFFFFFFFF, 10, 10);
+    int32_t vx, vy;
+    report(!odometry.getVelocity(1, 1000000, &vx, &vy), "Odometry::getVelocity", "velocity with no time elapsed");
+}
+
+static void check_near(const char * what, int64_t got, double want, double tolerance)
+{
+    char detail[100];
+    snprintf(detail, sizeof(detail), "got %lld, want %.2f", (long long)got, want);
+    // allowing for the rounding of want
+    report(fabs(got - want) <= tolerance + 1e-6, what, detail);
+}
+
+// Egomotion: grids of flow from random translation, rotation and divergence, 
+// rounded to whole counts, with every patch or some left out.  The estimate must 
+// be within a count of the least-squares fit to the rounded flows, computed in
+// floating point, and within the rounding of the flows of the motion that made 
+// them.  The focus of expansion and time to contact follow from the estimate, and 
+// must be within a count of the same formulas in floating point.
+static void check_egomotion(void)
+{
+    static const uint8_t MAXGRID = 9;
+
+    static const uint8_t grids[][2] = {{3,3}, {4,6}, {5,7}, {9,9}, {2,8}};
+
+    for (uint8_t g=0; g<sizeof(grids)/sizeof(grids[0]); ++g)
+        for (uint16_t trial=0; trial<200; ++trial) {
+
+            const uint8_t rows = grids[g][0];
+            const uint8_t cols = grids[g][1];
+
+            // translation of up to 500 counts, divergence and rotation of up to 50 
+            // counts per spacing
+            const double tx = random_flow(500);
+            const double ty = random_flow(500);
+            const double d = random_flow(50 << OFO_QBITS) / (double)(1 << OFO_QBITS);
+            const double w = random_flow(50 << OFO_QBITS) / (double)(1 << OFO_QBITS);
+
+            // every patch on even trials, about three quarters of them on odd
+            int16_t ofx[MAXGRID*MAXGRID];
+            int16_t ofy[MAXGRID*MAXGRID];
+            bool valid[MAXGRID*MAXGRID];
+
+            double n = 0, sx = 0, sy = 0, sxx = 0, su = 0, sv = 0, sp = 0, sq = 0;
+
+            for (uint8_t r=0; r<rows; ++r)
+                for (uint8_t c=0; c<cols; ++c) {
+                    const uint16_t i = r*cols + c;
+                    const double x = c - (cols-1) / 2.;
+                    const double y = r - (rows-1) / 2.;
+                    ofx[i] = (int16_t)lround(tx + d*x - w*y);
+                    ofy[i] = (int16_t)lround(ty + d*y + w*x);
+                    valid[i] = !(trial & 1) || (xorshift() & 3);
+                    if (valid[i]) {
+                        n++;
+                        sx += x;
+                        sy += y;
+                        sxx += x*x + y*y;
+                        su += ofx[i];
+                        sv += ofy[i];
+                        sp += x*ofx[i] + y*ofy[i];
+                        sq += x*ofy[i] - y*ofx[i];
+                    }
+                }
+
+            Egomotion ego;
+            bool ok = ofoEgomotion(ofx, ofy, valid, rows, cols, &ego);
+
+            const double den = n*sxx - sx*sx - sy*sy;
+
+            // patches in a single row or column, or fewer than two, have no fit
+            if (den < 1e-9) {
+                report(!ok, "ofoEgomotion", "fit to patches that do not span two dimensions");
+                continue;
+            }
+
+            report(ok, "ofoEgomotion", "no fit");
+            if (!ok)
+                continue;
+
+            const double fd = (n*sp - sx*su - sy*sv) / den;
+            const double fw = (n*sq - sx*sv + sy*su) / den;
+            const double ftx = (su - sx*fd + sy*fw) / n;
+            const double fty = (sv - sy*fd - sx*fw) / n;
+
+            check_near("ofoEgomotion divergence", ego.divergence, fd * (1 << OFO_QBITS), 1);
+            check_near("ofoEgomotion rotation", ego.rotation, fw * (1 << OFO_QBITS), 1);
+            // the translation is truncated, after the truncated slopes are carried to the
+            // mean position
+            const double carried = (fabs(sx) + fabs(sy)) / n / (1 << OFO_QBITS);
+            check_near("ofoEgomotion X translation", ego.tx, ftx, 1 + carried);
+            check_near("ofoEgomotion Y translation", ego.ty, fty, 1 + carried);
+
+            // the flows were rounded by at most half a count, which moves each slope 
+            // by at most half the sum of the distances from the mean position over 
+            // the sum of their squares
+            double sabs = 0;
+            for (uint8_t r=0; r<rows; ++r)
+                for (uint8_t c=0; c<cols; ++c)
+                    if (valid[r*cols + c])
+                        sabs += fabs(c - (cols-1) / 2. - sx/n) + fabs(r - (rows-1) / 2. - sy/n);
+            const double slope = 0.5 * sabs / (den / n) * (1 << OFO_QBITS) + 1;
+            check_near("ofoEgomotion divergence from motion", ego.divergence, d * (1 << OFO_QBITS), slope);
+            check_near("ofoEgomotion rotation from motion", ego.rotation, w * (1 << OFO_QBITS), slope);
+
+            // focus of expansion from the estimate
+            const double ed = ego.divergence;
+            const double ew = ego.rotation;
+            int32_t foex, foey;
+            ok = ofoFocusOfExpansion(&ego, &foex, &foey);
+            if (ed == 0 && ew == 0)
+                report(!ok, "ofoFocusOfExpansion", "focus with no divergence or rotation");
+            else if (ok) {
+                const double q = 1 << (2*OFO_QBITS);
+                check_near("ofoFocusOfExpansion X", foex, -(ed*ego.tx + ew*ego.ty) * q / (ed*ed + ew*ew), 1);
+                check_near("ofoFocusOfExpansion Y", foey, -(ed*ego.ty - ew*ego.tx) * q / (ed*ed + ew*ew), 1);
+            }
+            else
+                report(false, "ofoFocusOfExpansion", "no focus");
+        }
+
+    // a pure expansion about a known point, e.g. (1.5, -0.75) spacings from the center
+    int16_t ofx[7*7];
+    int16_t ofy[7*7];
+    for (uint8_t r=0; r<7; ++r)
+        for (uint8_t c=0; c<7; ++c) {
+            ofx[r*7+c] = (int16_t)lround(40 * ((c - 3) - 1.5));
+            ofy[r*7+c] = (int16_t)lround(40 * ((r - 3) + 0.75));
+        }
+    Egomotion ego;
+    int32_t foex = 0, foey = 0;
+    report(ofoEgomotion(ofx, ofy, NULL, 7, 7, &ego) && ofoFocusOfExpansion(&ego, &foex, &foey), 
+            "ofoFocusOfExpansion", "no focus of a pure expansion");
+    check_near("ofoFocusOfExpansion X of pure expansion", foex, 1.5 * (1 << OFO_QBITS), 1);
+    check_near("ofoFocusOfExpansion Y of pure expansion", foey, -0.75 * (1 << OFO_QBITS), 1);
+
+    // no divergence or rotation, so no focus
+    for (uint8_t i=0; i<7*7; ++i) {
+        ofx[i] = 25;
+        ofy[i] = -3;
+    }
+    report(ofoEgomotion(ofx, ofy, NULL, 7, 7, &ego) && !ofoFocusOfExpansion(&ego, &foex, &foey), 
+            "ofoFocusOfExpansion", "focus of a pure translation");
+}
+
+// Time to contact: a grid of image-interpolation flows from an image growing by a
+// fraction e each frame must give 1/e frames, for every combination of scale and 
+// spacing; shrinking images and none must give no time
+static void check_timetocontact(void)
+{
+    static const double growths[] = {0.005, 0.01, 0.02, 0.05, 0.1};
+    static const int16_t flowscales[] = {-256, -128, -64, 256};
+    static const uint16_t spacings[] = {4, 8, 16};
+
+    for (uint8_t e=0; e<sizeof(growths)/sizeof(growths[0]); ++e)
+        for (uint8_t f=0; f<sizeof(flowscales)/sizeof(flowscales[0]); ++f)
+            for (uint8_t s=0; s<sizeof(spacings)/sizeof(spacings[0]); ++s)
+                for (int8_t sign=-1; sign<=1; sign+=2) {
+
+                    const double growth = sign * growths[e];
+                    const int16_t flowscale = flowscales[f];
+                    const uint16_t spacing = spacings[s];
+
+                    // a pixel at x pixels from the center moves by growth*x pixels
+                    int16_t ofx[5*5];
+                    int16_t ofy[5*5];
+                    for (uint8_t r=0; r<5; ++r)
+                        for (uint8_t c=0; c<5; ++c) {
+                            ofx[r*5+c] = (int16_t)lround(flowscale * growth * (c - 2) * spacing);
+                            ofy[r*5+c] = (int16_t)lround(flowscale * growth * (r - 2) * spacing);
+                        }
+
+                    Egomotion ego;
+                    ofoEgomotion(ofx, ofy, NULL, 5, 5, &ego);
+
+                    int32_t frames = 0;
+                    bool ok = ofoTimeToContact(&ego, flowscale, spacing, &frames);
+
+                    char what[100];
+                    snprintf(what, sizeof(what), "ofoTimeToContact growing %g, flow scale %d, spacing %d", 
+                            growth, flowscale, spacing);
+
+                    if (growth < 0) {
+                        report(!ok, what, "time to contact while receding");
+                        continue;
+                    }
+
+                    report(ok, what, "no time to contact");
+
+                    // within a count of the divergence found, and within the rounding
+                    // of the flows of the growth that made them
+                    const double q = 1 << (2*OFO_QBITS);
+                    check_near(what, frames, (double)flowscale * spacing * q / ego.divergence, 1);
+                    const double exact = (1 << OFO_QBITS) / growth;
+                    const double slope = fabs(flowscale * growth * spacing);
+                    check_near(what, frames, exact, exact * 0.5 / slope + 1);
+                }
+
+    // no divergence
+    Egomotion ego = {10, 10, 0, 100};
+    int32_t frames;
+    report(!ofoTimeToContact(&ego, -256, 8, &frames), "ofoTimeToContact", "time to contact with no divergence");
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    check_displacement();
+    check_deadband();
+    check_velocity();
+    check_egomotion();
+    check_timetocontact();
+
+    if (failures) {
+        printf("%lu of %lu FAILED\n", (unsigned long)failures, (unsigned long)checked);
+        return 1;
+    }
+
+    printf("%lu motions checked\n", (unsigned long)checked);
+    return 0;
+}
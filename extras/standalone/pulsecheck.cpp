@@ -0,0 +1,198 @@
+/*
+pulsecheck.cpp checks the pulse count and shadow registers of the Stonyman
+library on a host computer.  A model of the chip, driven by the pin writes of
+the mock Arduino API, counts the pulses on each pin and follows the chip's
+register pointer and registers.  The check fails if the library's pulse count
+differs from the model's, if a register change that the shadow registers should
+reach by incrementing (or skip altogether) takes more pulses than that, or if
+any register ends up different from what the library asked for.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <Arduino.h>
+#include <Stonyman.h>
+
+#include <stdio.h>
+
+// Pins, in the order taken by the Stonyman constructor
+static const uint8_t RESP  = 3;
+static const uint8_t INCP  = 4;
+static const uint8_t RESV  = 5;
+static const uint8_t INCV  = 8;
+static const uint8_t INPHI = 9;
+
+// System registers
+static const uint8_t COLSEL = 0;
+static const uint8_t ROWSEL = 1;
+static const uint8_t VREF   = 4;
+static const uint8_t CONFIG = 5;
+static const uint8_t NBIAS  = 6;
+static const uint8_t AOBIAS = 7;
+
+// Model of the chip: pin levels, pointer, and eight-bit registers
+static uint8_t  levels[256];
+static uint8_t  pointer;
+static uint8_t  regs[8];
+static uint32_t pulses;
+
+static uint32_t failures;
+
+static Stonyman stonyman(RESP, INCP, RESV, INCV, INPHI);
+
+static void chip(uint8_t pin, uint8_t value)
+{
+    bool rising = value && !levels[pin];
+
+    levels[pin] = value;
+
+    if (!rising)
+        return;
+
+    pulses++;
+
+    if (pin == RESP)
+        pointer = 0;
+    else if (pin == INCP)
+        pointer++;
+    else if (pin == RESV)
+        regs[pointer & 7] = 0;
+    else if (pin == INCV)
+        regs[pointer & 7]++;
+}
+
+static void expect(const char * what, bool ok)
+{
+    printf("%-58s %s\n", what, ok ? "ok" : "FAILED");
+
+    if (!ok)
+        failures++;
+}
+
+// Checks that an operation took the expected number of pulses, as counted by
+// both the library and the model
+static void expect_pulses(const char * what, uint32_t count)
+{
+    char line[80];
+    snprintf(line, sizeof(line), "%s: %lu pulses", what, (unsigned long)stonyman.getPulseCount());
+
+    expect(line, stonyman.getPulseCount() == count && pulses == count);
+
+    stonyman.resetPulseCount();
+    pulses = 0;
+}
+
+// Checks that each pixel is read with the row and column registers selecting it
+class PositionGrabber final : public FrameGrabber {
+
+    friend class Stonyman;
+
+    private:
+
+    uint8_t _rowstart, _rowstride, _colstart, _colstride;
+    uint32_t _wrong;
+
+    protected:
+
+    virtual void handlePixel(uint8_t row, uint8_t col, uint16_t pixel, bool use_amp) override
+    {
+        (void)pixel;
+        (void)use_amp;
+
+        if (regs[ROWSEL] != (uint8_t)(_rowstart + row*_rowstride) ||
+                regs[COLSEL] != (uint8_t)(_colstart + col*_colstride))
+            _wrong++;
+    }
+
+    public:
+
+    PositionGrabber(uint8_t rowstart, uint8_t rowstride, uint8_t colstart, uint8_t colstride) : 
+        _rowstart(rowstart), _rowstride(rowstride), _colstart(colstart), _colstride(colstride), _wrong(0) { }
+
+    uint32_t wrong(void) { return _wrong; }
+};
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    mock_pinhook = chip;
+
+    // registers hold junk at power-up
+    for (uint8_t i=0; i<8; ++i)
+        regs[i] = 0x5A + i;
+    pointer = 3;
+
+    stonyman.begin(41, 50, 55);
+    expect("begin() sets biases and configuration",
+            regs[VREF] == 41 && regs[NBIAS] == 50 && regs[AOBIAS] == 55 && regs[CONFIG] == 16);
+    expect("library and model count the same pulses", stonyman.getPulseCount() == pulses);
+
+    stonyman.resetPulseCount();
+    pulses = 0;
+    expect_pulses("resetPulseCount() zeroes the count", 0);
+
+    // pointer is at CONFIG after begin()
+    stonyman.setConfig(0, 0, 1);
+    expect_pulses("unchanged register is skipped", 0);
+
+    stonyman.setNbias(50);
+    expect_pulses("pointer up 1, value unchanged", 1);
+
+    stonyman.setVref(41);
+    expect_pulses("pointer down to 4 resets it, value unchanged", 1 + 4);
+
+    stonyman.setVref(46);
+    expect_pulses("value up 5", 5);
+
+    stonyman.setVref(40);
+    expect_pulses("value down to 40 resets it", 1 + 40);
+
+    stonyman.setAobias(55);
+    expect_pulses("pointer up 3, value unchanged", 3);
+
+    stonyman.setVref(40);
+    expect_pulses("pointer down to 4 resets it, value unchanged", 1 + 4);
+
+    expect("registers hold what was asked for",
+            regs[VREF] == 40 && regs[NBIAS] == 50 && regs[AOBIAS] == 55 && regs[CONFIG] == 16);
+
+    // frames, with every pixel checked for position; the second frame takes the
+    // column register past where the library can be sure it has not wrapped
+    static const uint8_t frames[3][6] = {
+        {0, 112, 1, 0, 112, 1},
+        {10, 20, 3, 7, 30, 9},
+        {4, 16, 4, 4, 16, 4}
+    };
+
+    for (uint8_t b=0; b<3; ++b) {
+
+        const uint8_t * f = frames[b];
+        ImageBounds bounds(f[0], f[1], f[2], f[3], f[4], f[5]);
+        PositionGrabber grabber(f[0], f[2], f[3], f[5]);
+        stonyman.processFrame(grabber, 0, bounds);
+
+        char line[80];
+        snprintf(line, sizeof(line), "frame %d: every pixel read at its row and column", b);
+        expect(line, grabber.wrong() == 0);
+
+        snprintf(line, sizeof(line), "frame %d: library and model count the same pulses", b);
+        expect(line, stonyman.getPulseCount() == pulses);
+
+        stonyman.resetPulseCount();
+        pulses = 0;
+    }
+
+    stonyman.setVref(40);
+    expect("registers unchanged by frames",
+            regs[VREF] == 40 && regs[NBIAS] == 50 && regs[AOBIAS] == 55 && regs[CONFIG] == 16);
+
+    if (failures) {
+        printf("%lu FAILED\n", (unsigned long)failures);
+        return 1;
+    }
+
+    printf("all pulse counts as expected\n");
+    return 0;
+}
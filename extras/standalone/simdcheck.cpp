@@ -0,0 +1,286 @@
+/*
+simdcheck.cpp checks that the SSE2 and AVX2 versions of the optical flow sums
+give exactly the same results as the generic versions, over random and extreme
+images of many sizes, strides, and pixel types: the plus and square sums, the
+one-dimensional sums, and the batched one-dimensional sums.  Extreme sixteen-bit
+images make the sums wrap, so all sums are compared modulo 2^32, as the vector
+versions are documented to match.  It includes the source of the vector versions
+so that each can be called directly, whichever one the processor would be given.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <OpticalFlowSIMD.cpp>
+
+#include <stdio.h>
+
+#ifdef OFO_SIMD
+
+static const uint16_t MAXROWS = 70;
+static const uint16_t MAXCOLS = 150;
+
+static uint32_t failures;
+static uint32_t checked;
+
+static uint32_t state = 2463534242UL;
+
+static uint32_t xorshift(void)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Image patterns: random pixels, and the extremes of the pixel type that make
+// the sixteen-bit differentials and 32-bit products wrap
+enum { RANDOM, ZERO, MAXIMUM, CHECKER, STRIPES, NOISE_EXTREMES, PATTERNS };
+
+static const char * pattern_names[PATTERNS] =
+{"random", "zero", "maximum", "checker", "stripes", "extremes"};
+
+template <typename P>
+static void fill(P * img, uint32_t n, uint16_t cols, uint8_t pattern, bool inverse)
+{
+    const P maxval = (P)~(P)0;
+
+    for (uint32_t k=0; k<n; ++k) {
+        bool on;
+        switch (pattern) {
+            case RANDOM:         img[k] = (P)xorshift(); continue;
+            case ZERO:           on = false; break;
+            case MAXIMUM:        on = true; break;
+            case CHECKER:        on = ((k % cols) ^ (k / cols)) & 1; break;
+            case STRIPES:        on = (k % cols) & 1; break;
+            default:             on = xorshift() & 1; break;
+        }
+        img[k] = (on != inverse) ? maxval : 0;
+    }
+}
+
+// Generic sums accumulated modulo 2^32, whose overflow is well defined
+typedef FlowSums<uint32_t> modsums_t;
+
+static bool same(const flowsums_t & a, const modsums_t & b)
+{
+    return (uint32_t)a.A11 == b.A11 && (uint32_t)a.A12 == b.A12 && (uint32_t)a.A22 == b.A22 && 
+        (uint32_t)a.b1 == b.b1 && (uint32_t)a.b2 == b.b2;
+}
+
+// The generic batched 1D sums, accumulated modulo 2^32
+template <typename P>
+static void batch_reference(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint32_t * top, uint32_t * bottom)
+{
+    for (uint16_t k=0; k<numstrips; ++k) {
+        top[k] = 0;
+        bottom[k] = 0;
+        for (uint16_t i=1; i+1<numpix; ++i) {
+            const P * f = curr_img + k + (uint32_t)i*pixstride;
+            int16_t deltax = (int16_t)(f[pixstride] - f[-pixstride]);
+            int16_t deltat = (int16_t)(last_img[k + (uint32_t)i*pixstride] - f[0]);
+            top[k]    += (uint32_t)deltat * deltax;
+            bottom[k] += (uint32_t)deltax * deltax;
+        }
+    }
+}
+
+static void report(bool ok, const char * kernel, const char * isa, const char * type, uint8_t pattern,
+        uint16_t rows, uint16_t cols, uint16_t stride)
+{
+    checked++;
+
+    if (ok)
+        return;
+
+    if (failures < 20)
+        printf("FAILED %s %s %s %s %dx%d stride %d\n", kernel, isa, type, pattern_names[pattern], rows, cols, stride);
+
+    failures++;
+}
+
+template <typename P>
+static void check_2d(const char * type, bool avx2)
+{
+    static P curr[MAXROWS*(MAXCOLS+7)];
+    static P last[MAXROWS*(MAXCOLS+7)];
+
+    static const uint16_t sizes[] = {0, 1, 2, 3, 4, 7, 8, 9, 10, 15, 16, 17, 18, 31, 33, 48, 64, 70};
+    const uint8_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    for (uint8_t pattern=0; pattern<PATTERNS; ++pattern) {
+        for (uint8_t i=0; i<nsizes; ++i) {
+            for (uint8_t j=0; j<nsizes; ++j) {
+                for (uint8_t pad=0; pad<8; pad+=7) {
+
+                    const uint16_t rows = sizes[i];
+                    const uint16_t cols = sizes[j] * 2 + (sizes[j] & 1);
+                    const uint16_t stride = cols + pad;
+
+                    if (rows > MAXROWS || cols > MAXCOLS)
+                        continue;
+
+                    fill(curr, (uint32_t)rows*stride, stride, pattern, false);
+                    fill(last, (uint32_t)rows*stride, stride, pattern, true);
+
+                    modsums_t want;
+                    flowsums_t got;
+
+                    ofo_sums_plus<P,0,0,int16_t,uint32_t>(curr, last, rows, cols, stride, stride, &want);
+                    sums_plus_sse2(curr, last, rows, cols, stride, stride, &got);
+                    report(same(got, want), "plus", "SSE2", type, pattern, rows, cols, stride);
+                    if (avx2) {
+                        sums_plus_avx2(curr, last, rows, cols, stride, stride, &got);
+                        report(same(got, want), "plus", "AVX2", type, pattern, rows, cols, stride);
+                    }
+
+                    ofo_sums_square<P,0,0,int16_t,uint32_t>(curr, last, rows, cols, stride, stride, &want);
+                    sums_square_sse2(curr, last, rows, cols, stride, stride, &got);
+                    report(same(got, want), "square", "SSE2", type, pattern, rows, cols, stride);
+                    if (avx2) {
+                        sums_square_avx2(curr, last, rows, cols, stride, stride, &got);
+                        report(same(got, want), "square", "AVX2", type, pattern, rows, cols, stride);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Eight-bit 1D sums of these sizes cannot overflow, so are compared with the
+// generic version directly
+static void check_1d(bool avx2)
+{
+    static pixel_t curr[1024];
+    static pixel_t last[1024];
+
+    for (uint8_t pattern=0; pattern<PATTERNS; ++pattern) {
+        for (uint16_t numpix=0; numpix<=600; numpix += numpix < 40 ? 1 : 37) {
+
+            fill(curr, numpix, 3, pattern, false);
+            fill(last, numpix, 3, pattern, true);
+
+            int32_t wt, wb, t, b;
+            ofo_sums_1d(curr, last, numpix, &wt, &wb);
+
+            sums_1d_sse2(curr, last, numpix, &t, &b);
+            report(t == wt && b == wb, "1D", "SSE2", "uint8_t", pattern, 1, numpix, numpix);
+
+            if (avx2) {
+                sums_1d_avx2(curr, last, numpix, &t, &b);
+                report(t == wt && b == wb, "1D", "AVX2", "uint8_t", pattern, 1, numpix, numpix);
+            }
+        }
+    }
+}
+
+// Strips lie next to each other (stripstride 1), a pixel apart by pixstride
+template <typename P>
+static void check_batch(const char * type, bool avx2)
+{
+    static const uint16_t STRIPS = 16;
+    static P curr[200*(STRIPS+5)];
+    static P last[200*(STRIPS+5)];
+
+    static const uint16_t counts[] = {0, 1, 2, 3, 4, 5, 17, 64, 199};
+
+    for (uint8_t pattern=0; pattern<PATTERNS; ++pattern) {
+        for (uint8_t i=0; i<sizeof(counts)/sizeof(counts[0]); ++i) {
+            for (uint16_t pixstride=STRIPS; pixstride<=STRIPS+5; pixstride+=5) {
+
+                const uint16_t numpix = counts[i];
+
+                fill(curr, (uint32_t)numpix*pixstride, pixstride, pattern, false);
+                fill(last, (uint32_t)numpix*pixstride, pixstride, pattern, true);
+
+                uint32_t wt[STRIPS], wb[STRIPS];
+                int32_t t[STRIPS], b[STRIPS];
+                batch_reference(curr, last, numpix, pixstride, STRIPS, wt, wb);
+
+                // eight-bit sums cannot overflow, so the generic version must agree 
+                // with the reference exactly
+                bool ok = true;
+                if (sizeof(P) == 1) {
+                    ofo_sums_1d_batch(curr, last, numpix, pixstride, STRIPS, 1, t, b);
+                    for (uint8_t k=0; k<STRIPS; ++k)
+                        ok = ok && (uint32_t)t[k] == wt[k] && (uint32_t)b[k] == wb[k];
+                    report(ok, "batch", "generic", type, pattern, numpix, STRIPS, pixstride);
+                }
+
+                // the vector versions need at least three pixels per strip
+                if (numpix < 3)
+                    continue;
+
+                ok = true;
+                sums_1d_batch_sse2(curr, last, numpix, pixstride, t, b);
+                sums_1d_batch_sse2(curr+8, last+8, numpix, pixstride, t+8, b+8);
+                for (uint8_t k=0; k<STRIPS; ++k)
+                    ok = ok && (uint32_t)t[k] == wt[k] && (uint32_t)b[k] == wb[k];
+                report(ok, "batch", "SSE2", type, pattern, numpix, STRIPS, pixstride);
+
+                if (avx2) {
+                    ok = true;
+                    sums_1d_batch_avx2(curr, last, numpix, pixstride, t, b);
+                    for (uint8_t k=0; k<STRIPS; ++k)
+                        ok = ok && (uint32_t)t[k] == wt[k] && (uint32_t)b[k] == wb[k];
+                    report(ok, "batch", "AVX2", type, pattern, numpix, STRIPS, pixstride);
+                }
+
+                // and through the dispatcher, whose vector versions take strips in 
+                // groups, with the rest left over for the generic version; only where 
+                // the generic version cannot overflow
+                if (sizeof(P) == 1) {
+                    ok = true;
+                    ofo_sums_1d_batch_rt(curr, last, numpix, pixstride, STRIPS-3, 1, t, b);
+                    for (uint8_t k=0; k<STRIPS-3; ++k)
+                        ok = ok && (uint32_t)t[k] == wt[k] && (uint32_t)b[k] == wb[k];
+                    report(ok, "batch", "dispatch", type, pattern, numpix, STRIPS-3, pixstride);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    const bool sse2 = have_sse2();
+    const bool avx2 = have_avx2();
+
+    if (!sse2) {
+        printf("no SSE2 on this processor; nothing to check\n");
+        return 0;
+    }
+
+    if (!avx2)
+        printf("no AVX2 on this processor; checking SSE2 only\n");
+
+    check_2d<uint8_t>("uint8_t", avx2);
+    check_2d<uint16_t>("uint16_t", avx2);
+    check_1d(avx2);
+    check_batch<uint8_t>("uint8_t", avx2);
+    check_batch<uint16_t>("uint16_t", avx2);
+
+    if (failures) {
+        printf("%lu of %lu FAILED\n", (unsigned long)failures, (unsigned long)checked);
+        return 1;
+    }
+
+    printf("%lu vector sums identical to generic sums\n", (unsigned long)checked);
+    return 0;
+}
+
+#else
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    printf("no vector versions on this processor; nothing to check\n");
+    return 0;
+}
+
+#endif
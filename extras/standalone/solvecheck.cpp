@@ -0,0 +1,214 @@
+/*
+solvecheck.cpp checks the 32-bit fixed-point solvers ofoLK_SolveFixed() and
+ofoIIA_SolveFixed(), and the 32-bit confidence ofoConfidenceFixed(), against exact
+solutions computed in 64 bits and more, over sums swept from zero to the limits
+of int32_t: random systems of every magnitude and conditioning, and every
+combination of extreme values.  Each output must be within the tolerances stated
+in OpticalFlow.h.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <OpticalFlow.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+static uint32_t failures;
+static uint32_t checked;
+static double worst;
+
+static uint32_t state = 2463534242UL;
+
+static uint32_t xorshift(void)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Random value of magnitude below 2^bits, with random sign if asked for
+static int32_t random_sum(uint8_t bits, bool sign)
+{
+    uint32_t mag = bits >= 32 ? xorshift() : xorshift() & ((1UL << bits) - 1);
+    if (mag > 0x7FFFFFFF)
+        mag = 0x7FFFFFFF;
+    return (sign && (xorshift() & 1)) ? -(int32_t)mag : (int32_t)mag;
+}
+
+// The shift that the solvers apply to the sums: the fewest bits that bring
+// every sum below 2^15 in magnitude
+static uint8_t shift_of(const flowsums_t & s)
+{
+    int32_t all[5] = {s.A11, s.A12, s.A22, s.b1, s.b2};
+    uint32_t biggest = 0;
+    for (uint8_t i=0; i<5; ++i) {
+        uint32_t mag = all[i] < 0 ? -(uint32_t)all[i] : (uint32_t)all[i];
+        if (mag > biggest)
+            biggest = mag;
+    }
+
+    uint8_t k = 0;
+    while (biggest >> 15) {
+        biggest >>= 1;
+        k++;
+    }
+    return k;
+}
+
+static int16_t saturate(int64_t q)
+{
+    return (int16_t)(q > 0x7FFF ? 0x7FFF : q < -0x7FFF ? -0x7FFF : q);
+}
+
+static void fail(const char * what, const flowsums_t & s, int16_t ofx, int16_t ofy, int16_t wantx, int16_t wanty)
+{
+    if (failures < 20)
+        printf("FAILED %s: A11=%ld A12=%ld A22=%ld b1=%ld b2=%ld got (%d,%d) want (%d,%d)\n", what,
+                (long)s.A11, (long)s.A12, (long)s.A22, (long)s.b1, (long)s.b2, ofx, ofy, wantx, wanty);
+    failures++;
+}
+
+static void check(flowsums_t sums)
+{
+    const flowsums_t s = sums;
+
+    int16_t ofx, ofy, iix, iiy;
+    bool ok = ofoLK_SolveFixed(&sums, &ofx, &ofy);
+    bool iiok = ofoIIA_SolveFixed(&sums, &iix, &iiy);
+
+    checked++;
+
+    // the image-interpolation shift is twice the Lucas-Kanade shift
+    if (iiok != ok || iix != saturate(2*(int64_t)ofx) || iiy != saturate(2*(int64_t)ofy))
+        fail("IIA", s, iix, iiy, saturate(2*(int64_t)ofx), saturate(2*(int64_t)ofy));
+
+    // exact solution of the shifted sums, rounded toward zero
+    const uint8_t k = shift_of(s);
+    int64_t A11 = s.A11 >> k, A12 = s.A12 >> k, A22 = s.A22 >> k, b1 = s.b1 >> k, b2 = s.b2 >> k;
+    int64_t det = A11*A22 - A12*A12;
+
+    if (det <= 0) {
+        if (ok || ofx || ofy)
+            fail("singular", s, ofx, ofy, 0, 0);
+    }
+    else {
+        int16_t wantx = saturate((b1*A22 - b2*A12) * (1 << OFO_QBITS) / det);
+        int16_t wanty = saturate((b2*A11 - b1*A12) * (1 << OFO_QBITS) / det);
+        if (!ok || ofx != wantx || ofy != wanty)
+            fail("shifted", s, ofx, ofy, wantx, wanty);
+    }
+
+    // 32-bit confidence against the exact confidence, with only the matrix sums shifted
+    uint32_t c = ofoConfidence(&sums);
+    flowsums_t a = {s.A11, s.A12, s.A22, 0, 0};
+    uint32_t cf = ofoConfidenceFixed(&sums);
+    if ((cf > c ? cf - c : c - cf) >= (uint64_t)3 << shift_of(a))
+        fail("confidence", s, (int16_t)(cf >> 16), (int16_t)cf, (int16_t)(c >> 16), (int16_t)c);
+
+    // against the exact solution of the unshifted sums, wherever the confidence
+    // bounds the error
+    if (c == 0)
+        return;
+
+    const double scale = 1 << k;
+
+    // a shifted system can only become singular if the perturbation swamps the
+    // smaller eigenvalue, which is at least the confidence
+    if (!ok) {
+        if (c >= 2 * scale)
+            fail("lost", s, ofx, ofy, 0, 0);
+        return;
+    }
+
+    // saturated outputs have no error bound
+    if (ofx == 0x7FFF || ofx == -0x7FFF || ofy == 0x7FFF || ofy == -0x7FFF)
+        return;
+
+    __int128 D  = (__int128)s.A11*s.A22 - (__int128)s.A12*s.A12;
+    __int128 NX = (__int128)s.b1*s.A22 - (__int128)s.b2*s.A12;
+    __int128 NY = (__int128)s.b2*s.A11 - (__int128)s.b1*s.A12;
+    double x = (double)NX / (double)D;
+    double y = (double)NY / (double)D;
+
+    const double lsb = 1.0 / (1 << OFO_QBITS);
+    double vx = ofx * lsb, vy = ofy * lsb;
+    double v = sqrt(vx*vx + vy*vy) + lsb;
+
+    // rounding errs by under one LSB in each component, and the perturbation moves 
+    // the solution by less than the bound in any direction
+    double bound = lsb + (1.5 + 2*v) * scale / c;
+    double error = fmax(fabs(vx-x), fabs(vy-y));
+
+    if (error >= bound)
+        fail("unshifted", s, ofx, ofy, (int16_t)(x/lsb), (int16_t)(y/lsb));
+
+    // IIA error is twice that of LK
+    double iierror = fmax(fabs(iix*lsb - 2*x), fabs(iiy*lsb - 2*y));
+    if (iix != 0x7FFF && iix != -0x7FFF && iiy != 0x7FFF && iiy != -0x7FFF && iierror >= 2*bound)
+        fail("IIA unshifted", s, iix, iiy, (int16_t)(2*x/lsb), (int16_t)(2*y/lsb));
+
+    if (error / lsb > worst && c >= (uint32_t)(scale * 4096))
+        worst = error / lsb;
+}
+
+// Random symmetric positive semi-definite systems: A11 and A22 up to 2^ea and 2^eb,
+// A12 a fraction rho of the geometric mean, b up to 2^ebits
+static void sweep_random(void)
+{
+    static const double rhos[] = {0, 0.25, 0.5, 0.9, 0.99, 0.9999, 0.999999, 1};
+
+    for (uint8_t ea=0; ea<=31; ++ea)
+        for (uint8_t eb=0; eb<=31; eb+=3)
+            for (uint8_t ebits=0; ebits<=32; ebits+=4)
+                for (uint8_t r=0; r<sizeof(rhos)/sizeof(rhos[0]); ++r)
+                    for (uint8_t n=0; n<8; ++n) {
+                        flowsums_t s;
+                        s.A11 = random_sum(ea, false);
+                        s.A22 = random_sum(eb, false);
+                        double g = sqrt((double)s.A11 * s.A22);
+                        s.A12 = (int32_t)(rhos[r] * g) * ((xorshift() & 1) ? -1 : 1);
+                        s.b1 = random_sum(ebits, true);
+                        s.b2 = random_sum(ebits, true);
+                        check(s);
+                    }
+}
+
+// Every combination of zero, unit and extreme sums, whether or not they could
+// come from images
+static void sweep_extremes(void)
+{
+    static const int32_t values[] = {0, 1, -1, 0x7FFF, 0x8000, -0x8000, -0x8001,
+        0xFFFF, 0x10000, 0x3FFFFFFF, -0x40000000, 0x7FFFFFFF, -0x7FFFFFFF, (int32_t)0x80000000};
+    const uint8_t n = sizeof(values) / sizeof(values[0]);
+
+    for (uint8_t i=0; i<n; ++i)
+        for (uint8_t j=0; j<n; ++j)
+            for (uint8_t k=0; k<n; ++k)
+                for (uint8_t l=0; l<n; ++l)
+                    for (uint8_t m=0; m<n; ++m) {
+                        flowsums_t s = {values[i], values[j], values[k], values[l], values[m]};
+                        check(s);
+                    }
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    sweep_random();
+    sweep_extremes();
+
+    printf("%lu systems, worst error %.2f LSB for well-textured systems\n", (unsigned long)checked, worst);
+
+    if (failures) {
+        printf("%lu FAILED\n", (unsigned long)failures);
+        return 1;
+    }
+
+    printf("all solutions within tolerance\n");
+    return 0;
+}
@@ -0,0 +1,287 @@
+/*
+sumcheck.cpp checks that the gradient-product sums of the two-dimensional optical
+flow kernels cannot overflow.  Pairs of saturated, maximum-contrast images,
+whose every differential has the largest magnitude the pixels allow, are summed
+by each entry point (image size at run time, in an ImageView window of a larger
+image, and at compile time) and compared with sums computed in 64 bits.  The 
+sums of the one-dimensional kernels, and the shifts ofoIIA_1D_Batch() solves 
+from them, are checked the same way on saturated strips.
+
+Copyright (C) 2017 Simon D. Levy
+*/
+
+#include <OpticalFlow.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const uint16_t MAXSIZE = 128;
+
+static int failures;
+
+// Exact sums in 64 bits, narrowed to the solvers' sums as the kernels do
+template <typename P>
+static void reference(const P * curr, const P * last, uint16_t rows, uint16_t cols, bool square,
+        flowsums_t * sums)
+{
+    FlowSums<int64_t> wide = {0, 0, 0, 0, 0};
+
+    for (uint16_t r=0; r+1<rows; ++r) {
+        for (uint16_t c=0; c+1<cols; ++c) {
+
+            int64_t dx, dy, dt;
+
+            if (square) {
+                int64_t f0 = curr[r*cols+c], f1 = curr[r*cols+c+1];
+                int64_t f2 = curr[(r+1)*cols+c], f3 = curr[(r+1)*cols+c+1];
+                dx = (f0 - f1) + (f2 - f3);
+                dy = (f0 - f2) + (f1 - f3);
+                dt = (int64_t)last[r*cols+c] - f0;
+            }
+            else {
+                if (r == 0 || c == 0)
+                    continue;
+                dx = (int64_t)curr[r*cols+c-1] - curr[r*cols+c+1];
+                dy = (int64_t)curr[(r-1)*cols+c] - curr[(r+1)*cols+c];
+                dt = (int64_t)last[r*cols+c] - curr[r*cols+c];
+            }
+
+            wide.A11 += dx * dx;
+            wide.A12 += dy * dx;
+            wide.A22 += dy * dy;
+            wide.b1  += dt * dx;
+            wide.b2  += dt * dy;
+        }
+    }
+
+    ofo_narrow(wide, sums);
+}
+
+// Stripes two pixels wide in each direction give every plus differential the
+// largest magnitude; stripes one pixel wide do the same for the square
+// configuration.  The previous image is the negative of the current one.
+template <typename P>
+static void saturate(P * curr, P * last, uint16_t rows, uint16_t cols, bool square, uint16_t maxval)
+{
+    for (uint16_t r=0; r<rows; ++r)
+        for (uint16_t c=0; c<cols; ++c) {
+            bool on = square ? (c & 1) == 0 : (((c >> 1) ^ (r >> 1)) & 1) == 1;
+            curr[r*cols+c] = on ? maxval : 0;
+            last[r*cols+c] = on ? 0 : maxval;
+        }
+}
+
+static void report(const char * what, const char * type, uint8_t bits, uint16_t rows, uint16_t cols,
+        bool square, const flowsums_t & got, const flowsums_t & want)
+{
+    bool ok = got.A11 == want.A11 && got.A12 == want.A12 && got.A22 == want.A22 &&
+        got.b1 == want.b1 && got.b2 == want.b2;
+
+    printf("%-9s %-8s %2d bits %3dx%-3d %-6s A11=%11ld b1=%11ld  %s\n",
+            what, type, bits, rows, cols, square ? "square" : "plus",
+            (long)got.A11, (long)got.b1, ok ? "ok" : "FAILED");
+
+    if (!ok) {
+        printf("    expected A11=%ld A12=%ld A22=%ld b1=%ld b2=%ld\n",
+                (long)want.A11, (long)want.A12, (long)want.A22, (long)want.b1, (long)want.b2);
+        failures++;
+    }
+}
+
+// Checks the entry points taking the size at run time, with and without BITS
+template <typename P, uint8_t BITS>
+static void check(const char * type, uint16_t rows, uint16_t cols)
+{
+    static P curr[MAXSIZE*MAXSIZE];
+    static P last[MAXSIZE*MAXSIZE];
+
+    // the same images as windows of larger ones
+    static P bigcurr[(MAXSIZE+2)*(MAXSIZE+3)];
+    static P biglast[(MAXSIZE+2)*(MAXSIZE+3)];
+
+    const uint16_t maxval = (uint16_t)((1UL << BITS) - 1);
+
+    for (uint8_t s=0; s<2; ++s) {
+
+        const bool square = s == 1;
+
+        saturate(curr, last, rows, cols, square, maxval);
+
+        ImageView<P> cview(bigcurr, rows+2, cols+3);
+        ImageView<P> lview(biglast, rows+2, cols+3);
+        ImageView<P> cwin = cview.window(1, 2, rows, cols);
+        ImageView<P> lwin = lview.window(1, 2, rows, cols);
+        for (uint16_t r=0; r<rows; ++r)
+            for (uint16_t c=0; c<cols; ++c) {
+                cwin.row(r)[c] = curr[r*cols+c];
+                lwin.row(r)[c] = last[r*cols+c];
+            }
+
+        flowsums_t want, got;
+        reference(curr, last, rows, cols, square, &want);
+
+        if (square)
+            ofoSums_Square_2D<P,BITS>(curr, last, rows, cols, &got);
+        else
+            ofoSums_Plus_2D<P,BITS>(curr, last, rows, cols, &got);
+        report("runtime", type, BITS, rows, cols, square, got, want);
+
+        if (square)
+            ofoSums_Square_2D(curr, last, rows, cols, &got);
+        else
+            ofoSums_Plus_2D(curr, last, rows, cols, &got);
+        report("fullbits", type, BITS, rows, cols, square, got, want);
+
+        if (square)
+            ofoSums_Square_2D<P,BITS>(cwin, lwin, &got);
+        else
+            ofoSums_Plus_2D<P,BITS>(cwin, lwin, &got);
+        report("window", type, BITS, rows, cols, square, got, want);
+    }
+}
+
+// Also checks the entry points taking the size at compile time
+template <typename P, uint8_t BITS, uint16_t ROWS, uint16_t COLS>
+static void check_sized(const char * type)
+{
+    check<P,BITS>(type, ROWS, COLS);
+
+    static P curr[ROWS*COLS];
+    static P last[ROWS*COLS];
+
+    const uint16_t maxval = (uint16_t)((1UL << BITS) - 1);
+
+    for (uint8_t s=0; s<2; ++s) {
+
+        const bool square = s == 1;
+
+        saturate(curr, last, ROWS, COLS, square, maxval);
+
+        flowsums_t want, got;
+        reference(curr, last, ROWS, COLS, square, &want);
+
+        if (square)
+            ofoSums_Square_2D<P,ROWS,COLS,BITS>(curr, last, &got);
+        else
+            ofoSums_Plus_2D<P,ROWS,COLS,BITS>(curr, last, &got);
+        report("sized", type, BITS, ROWS, COLS, square, got, want);
+    }
+}
+
+// Exact one-dimensional sums of a strip in 64 bits, narrowed as the kernels do
+template <typename P>
+static void reference_1d(const P * curr, const P * last, uint16_t numpix, uint16_t pixstride, 
+        int32_t * top, int32_t * bottom)
+{
+    int64_t t = 0;
+    int64_t b = 0;
+
+    for (uint16_t i=1; i+1<numpix; ++i) {
+        int64_t dx = (int64_t)curr[(i+1)*pixstride] - curr[(i-1)*pixstride];
+        int64_t dt = (int64_t)last[i*pixstride] - curr[i*pixstride];
+        t += dt * dx;
+        b += dx * dx;
+    }
+
+    ofo_narrow_1d(t, b, top, bottom);
+}
+
+// Checks the one-dimensional sums of saturated strips, stored one after another 
+// and interleaved, and the shifts of ofoIIA_1D_Batch() solved from them.  Stripes 
+// two pixels wide give every differential the largest magnitude.
+template <typename P, uint8_t BITS>
+static void check_1d(const char * type, uint16_t numpix)
+{
+    static const uint8_t STRIPS = 3;
+
+    static P curr[STRIPS*40000];
+    static P last[STRIPS*40000];
+
+    const uint16_t maxval = (uint16_t)((1UL << BITS) - 1);
+
+    for (uint8_t l=0; l<2; ++l) {
+
+        // strips one after another, or interleaved
+        const bool interleaved = l == 1;
+        const uint16_t pixstride = interleaved ? STRIPS : 1;
+        const uint16_t stripstride = interleaved ? 1 : numpix;
+
+        for (uint8_t k=0; k<STRIPS; ++k)
+            for (uint16_t i=0; i<numpix; ++i) {
+                // each strip differently offset, so that their sums differ
+                bool on = (((i + k) >> 1) & 1) == 1;
+                curr[k*stripstride + i*pixstride] = on ? maxval : 0;
+                last[k*stripstride + i*pixstride] = on ? 0 : maxval;
+            }
+
+        int32_t top[STRIPS], bottom[STRIPS];
+        ofo_sums_1d_wide<BITS>(curr, last, numpix, pixstride, STRIPS, stripstride, top, bottom);
+
+        int16_t out[STRIPS];
+        ofoIIA_1D_Batch<P,BITS>(curr, last, numpix, pixstride, STRIPS, stripstride, 256, out);
+
+        for (uint8_t k=0; k<STRIPS; ++k) {
+
+            int32_t wt, wb;
+            reference_1d(curr + k*stripstride, last + k*stripstride, numpix, pixstride, &wt, &wb);
+            int16_t wout = ofoIIA_1D_Solve(wt, wb, 256);
+
+            bool ok = top[k] == wt && bottom[k] == wb && out[k] == wout;
+
+            printf("%-9s %-8s %2d bits %5d    %-6s top=%11ld bottom=%11ld  %s\n",
+                    "1d", type, BITS, numpix, interleaved ? "strided" : "strips", 
+                    (long)top[k], (long)bottom[k], ok ? "ok" : "FAILED");
+
+            if (!ok) {
+                printf("    expected top=%ld bottom=%ld shift=%d, got shift %d\n", 
+                        (long)wt, (long)wb, wout, out[k]);
+                failures++;
+            }
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    // Ten-bit pixels from the Arduino ADC, and masked Stonyman images
+    check_sized<uint16_t, 10, 16, 16>("uint16_t");
+    check_sized<uint16_t, 10, 22, 22>("uint16_t");
+    check_sized<uint16_t, 10, 48, 48>("uint16_t");
+    check_sized<uint16_t, 11, 16, 16>("uint16_t");
+    check_sized<uint16_t, 11, 112, 112>("uint16_t");
+
+    // Eight-bit pixels, below and above 90x90, beyond which square sums need
+    // more than 32 bits
+    check_sized<uint8_t, 8, 48, 48>("uint8_t");
+    check_sized<uint8_t, 8, 90, 90>("uint8_t");
+    check_sized<uint8_t, 8, 91, 91>("uint8_t");
+    check_sized<uint8_t, 8, 128, 128>("uint8_t");
+
+    // Pixels spanning all sixteen bits, for which even one row overflows
+    check_sized<uint16_t, 16, 10, 10>("uint16_t");
+    check_sized<uint16_t, 16, 48, 48>("uint16_t");
+
+    // Sizes that do not divide evenly into bands
+    check<uint16_t, 12>("uint16_t", 37, 101);
+    check<uint8_t, 8>("uint8_t", 127, 113);
+
+    // One-dimensional sums within 32 bits, in segments added in 64 bits, and of
+    // sixteen-bit values such as row-sum projections, in 64 bits throughout
+    check_1d<uint8_t, 8>("uint8_t", 100);
+    check_1d<uint8_t, 8>("uint8_t", 40000);
+    check_1d<uint16_t, 10>("uint16_t", 100);
+    check_1d<uint16_t, 10>("uint16_t", 5001);
+    check_1d<uint16_t, 16>("uint16_t", 10);
+    check_1d<uint16_t, 16>("uint16_t", 1000);
+
+    if (failures) {
+        printf("%d FAILED\n", failures);
+        return 1;
+    }
+
+    printf("all sums exact\n");
+    return 0;
+}
@@ -78,6 +78,32 @@ void imgCopy(uint8_t *src, uint8_t *dst,  uint16_t numpix)
     }
 }
 
+void imgCopy(ImageView<uint16_t> src, uint16_t * dst)
+{
+    uint16_t *pb = dst;
+    for (uint16_t r=0; r<src.rows(); ++r) {
+        uint16_t *pa = src.row(r);
+        for (uint16_t c=0; c<src.cols(); ++c) {
+            *pb = *pa;
+            pa++; 
+            pb++;
+        }
+    }
+}
+
+void imgCopy(ImageView<uint8_t> src, uint8_t * dst)
+{
+    uint8_t *pb = dst;
+    for (uint16_t r=0; r<src.rows(); ++r) {
+        uint8_t *pa = src.row(r);
+        for (uint16_t c=0; c<src.cols(); ++c) {
+            *pb = *pa;
+            pa++; 
+            pb++;
+        }
+    }
+}
+
 void imgDumpAscii(uint16_t *img, uint16_t numrows, uint16_t numcolumns, uint16_t mini, uint16_t maxi) 
 {
     // if mini==0 then we compute minimum
@@ -155,6 +181,21 @@ uint16_t imgMin(uint16_t *A,  uint16_t numpix)
     return minval;
 }
 
+uint16_t imgMin(ImageView<uint16_t> img) 
+{
+    uint16_t minval = *img.pixels();
+
+    for (uint16_t r=0; r<img.rows(); ++r) {
+        uint16_t *pa = img.row(r);
+        for (uint16_t c=0; c<img.cols(); ++c) {
+            if (*pa < minval)
+                minval = *pa;
+            ++pa;
+        }
+    }
+    return minval;
+}
+
 uint16_t imgMax(uint16_t *A,  uint16_t numpix) 
 {
     uint16_t *pa = A;
@@ -169,6 +210,21 @@ uint16_t imgMax(uint16_t *A,  uint16_t numpix)
     return maxval;
 }
 
+uint16_t imgMax(ImageView<uint16_t> img) 
+{
+    uint16_t maxval = *img.pixels();
+
+    for (uint16_t r=0; r<img.rows(); ++r) {
+        uint16_t *pa = img.row(r);
+        for (uint16_t c=0; c<img.cols(); ++c) {
+            if (*pa > maxval)
+                maxval = *pa;
+            ++pa;
+        }
+    }
+    return maxval;
+}
+
 void imgDiff(uint16_t *A, uint16_t *B, uint16_t *D,  uint16_t numpix) 
 {
     uint16_t *pa = A;
@@ -224,7 +280,7 @@ void imgMakeFpn( uint8_t *F,  uint16_t numpix,  uint8_t modval)
 }
 
 
-void imgSubwinShort2D(
+void imgSubwin2D(
         uint16_t *I, 
         uint16_t *S, 
         uint8_t Icols, 
@@ -233,19 +289,10 @@ void imgSubwinShort2D(
         uint8_t startcol, 
         uint8_t numcols) 
 {
-    uint16_t * ps = S;
-
-    for (uint8_t r=0; r<numrows; ++r) {
-        uint16_t * pi = I + Icols*(startrow+r) + startcol;
-        for (uint8_t c=0; c<numcols; ++c) {
-            *ps = *pi;
-            ps++;
-            pi++;
-        }
-    }
+    imgCopy(ImageView<uint16_t>(I, startrow+numrows, Icols).window(startrow, startcol, numrows, numcols), S);
 }
 
-void imgSubwinShort2Dto1DVertical(
+void imgSubwin2Dto1DVertical(
         uint16_t *I, 
         uint16_t *S, 
         uint8_t Icols, 
@@ -254,22 +301,10 @@ void imgSubwinShort2Dto1DVertical(
         uint8_t Snumpix, 
         uint8_t Spixlength) 
 {
-
-    // first clear image S
-    for (uint8_t r=0; r<Snumpix; ++r) {
-        S[r]=0;
-    }
-
-    for (uint8_t r=0; r<Spixlength; ++r) {
-        uint16_t * pi = I + Icols*(subrow+r) + subcol;
-        for (uint8_t c=0; c<Snumpix; ++c) {
-            S[c] += *pi;
-            pi++;
-        }
-    }
+    imgSubwin2Dto1DVertical(ImageView<uint16_t>(I + Icols*subrow + subcol, Spixlength, Snumpix, Icols), S);
 }
 
-void imgSubwinShort2Dto1DHorizontal(
+void imgSubwin2Dto1DHorizontal(
         uint16_t *I, 
         uint16_t *S, 
         uint8_t Icols, 
@@ -278,21 +313,121 @@ void imgSubwinShort2Dto1DHorizontal(
         uint8_t Snumpix, 
         uint8_t Spixlength) 
 {
+    imgSubwin2Dto1DHorizontal(ImageView<uint16_t>(I + Icols*subrow + subcol, Snumpix, Spixlength, Icols), S);
+}
 
-    // first clear image S
-    for (uint8_t r=0; r<Snumpix; ++r) {
-        S[r]=0;
+void imgSubwin2Dto1DVertical(ImageView<uint16_t> src, uint16_t * dst)
+{
+    // first clear destination
+    for (uint16_t c=0; c<src.cols(); ++c) {
+        dst[c]=0;
+    }
+
+    for (uint16_t r=0; r<src.rows(); ++r) {
+        uint16_t * pi = src.row(r);
+        for (uint16_t c=0; c<src.cols(); ++c) {
+            dst[c] += *pi;
+            pi++;
+        }
     }
+}
 
-    for (uint8_t r=0; r<Snumpix; ++r) {
-        uint16_t * pi = I + Icols*(subrow+r) + subcol;
-        for (uint8_t c=0; c<Spixlength; ++c) {
-            S[r] += *pi;
+void imgSubwin2Dto1DHorizontal(ImageView<uint16_t> src, uint16_t * dst)
+{
+    for (uint16_t r=0; r<src.rows(); ++r) {
+        uint16_t * pi = src.row(r);
+        dst[r] = 0;
+        for (uint16_t c=0; c<src.cols(); ++c) {
+            dst[r] += *pi;
             pi++;
         }
     }
 }
 
+template <typename T>
+static void downsample2x2(T * src, uint16_t rows, uint16_t cols, T * dst)
+{
+    T * pd = dst;
+
+    for (uint16_t r=0; r<rows/2; ++r) {
+        T * pa = src + (uint32_t)(2*r)*cols;
+        T * pb = pa + cols;
+        for (uint16_t c=0; c<cols/2; ++c) {
+            *pd = (T)(((uint32_t)pa[0] + pa[1] + pb[0] + pb[1] + 2) >> 2);
+            pa += 2;
+            pb += 2;
+            pd++;
+        }
+    }
+}
+
+void imgDownsample2x2(uint16_t * src, uint16_t rows, uint16_t cols, uint16_t * dst)
+{
+    downsample2x2(src, rows, cols, dst);
+}
+
+void imgDownsample2x2(uint8_t * src, uint16_t rows, uint16_t cols, uint8_t * dst)
+{
+    downsample2x2(src, rows, cols, dst);
+}
+
+// Splits a source coordinate in 1/256 pixel into a whole pixel within [0,size-2]
+// and a fraction, clamping to the edges of the image
+static void warp_coord(int32_t pos, uint16_t size, uint16_t * whole, uint16_t * frac)
+{
+    if (size < 2 || pos < 0) {
+        *whole = 0;
+        *frac = 0;
+    }
+    else if (pos >= ((int32_t)(size-1) << 8)) {
+        *whole = size - 2;
+        *frac = 256;
+    }
+    else {
+        *whole = pos >> 8;
+        *frac = pos & 0xFF;
+    }
+}
+
+template <typename T>
+static void warp_bilinear(T * src, uint16_t rows, uint16_t cols, int32_t dx, int32_t dy, T * dst)
+{
+    T * pd = dst;
+
+    for (uint16_t r=0; r<rows; ++r) {
+
+        uint16_t y, fy;
+        warp_coord(((int32_t)r << 8) - dy, rows, &y, &fy);
+
+        T * pa = src + (uint32_t)y*cols;
+        T * pb = rows > 1 ? pa + cols : pa;
+
+        for (uint16_t c=0; c<cols; ++c) {
+
+            uint16_t x, fx;
+            warp_coord(((int32_t)c << 8) - dx, cols, &x, &fx);
+
+            uint16_t x1 = cols > 1 ? x + 1 : x;
+
+            // interpolate along each row, then between the rows; at most 2^32 - 2^16
+            uint32_t top = (uint32_t)pa[x] * (256 - fx) + (uint32_t)pa[x1] * fx;
+            uint32_t bot = (uint32_t)pb[x] * (256 - fx) + (uint32_t)pb[x1] * fx;
+
+            *pd++ = (T)((top * (256 - fy) + bot * fy + 0x8000) >> 16);
+        }
+    }
+}
+
+void imgWarpBilinear(uint16_t * src, uint16_t rows, uint16_t cols, int32_t dx, int32_t dy, uint16_t * dst)
+{
+    warp_bilinear(src, rows, cols, dx, dy, dst);
+}
+
+void imgWarpBilinear(uint8_t * src, uint16_t rows, uint16_t cols, int32_t dx, int32_t dy, uint8_t * dst)
+{
+    warp_bilinear(src, rows, cols, dx, dy, dst);
+}
+
 void imgCalcMask(uint16_t *img, uint16_t size, uint8_t *mask,uint16_t *maskBase)
 {
     *maskBase = 10000; // e.g. "high"
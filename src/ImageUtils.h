@@ -34,6 +34,8 @@ policies, either expressed or implied, of Centeye, Inc.
 
 #pragma once
 
+#include <stdint.h>
+
 /**
  * @file ImageUtils.h
  * 
@@ -59,6 +61,89 @@ policies, either expressed or implied, of Centeye, Inc.
  * operations) do require the dimensions of the image.
  */
 
+/**
+ * A view of a rectangle of pixels in a larger image, for processing part of the 
+ * image in place instead of copying it out.  Rows of the view start <tt>stride</tt> 
+ * pixels apart in memory; for a whole image the stride is just the number of columns.
+ * For example, with an image A of 4 rows and 6 columns as above, 
+ *
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>ImageView<uint16_t>(A, 4, 6).window(1, 2, 2, 3)</tt>
+ *
+ * is the 2x3 rectangle whose upper-left pixel is A[8], with stride 6.  Views can
+ * also be made over images from other libraries; e.g., for an OpenCV cv::Mat M of 
+ * eight-bit pixels, <tt>ImageView<uint8_t>(M.data, M.rows, M.cols, M.step)</tt>.
+ *
+ * A view does not own its pixels, and is small enough to pass by value.
+ *
+ * @param T pixel type
+ */
+template <typename T>
+class ImageView {
+
+    private:
+
+        T * _pixels;
+        uint16_t _rows;
+        uint16_t _cols;
+        uint16_t _stride;
+
+    public:
+
+        /**
+          * Constructs a view of an image.
+          * @param pixels first pixel of the image
+          * @param rows number of rows
+          * @param cols number of columns
+          * @param stride number of pixels from the start of one row to the start of the next;
+          * zero means the same as cols
+          */
+        ImageView(T * pixels, uint16_t rows, uint16_t cols, uint16_t stride=0) :
+            _pixels(pixels), _rows(rows), _cols(cols), _stride(stride ? stride : cols) { }
+
+        /**
+          * Returns a view of a rectangle within this view.
+          * @param row row of upper-left pixel of rectangle
+          * @param col column of upper-left pixel of rectangle
+          * @param numrows number of rows of rectangle
+          * @param numcols number of columns of rectangle
+          * @return view of the rectangle
+          */
+        ImageView<T> window(uint16_t row, uint16_t col, uint16_t numrows, uint16_t numcols) const
+        {
+            return ImageView<T>(_pixels + (uint32_t)row*_stride + col, numrows, numcols, _stride);
+        }
+
+        /**
+          * Returns the first pixel of a row.
+          * @param r row index
+          * @return pointer to pixel
+          */
+        T * row(uint16_t r) const 
+        { 
+            return _pixels + (uint32_t)r*_stride; 
+        }
+
+        T * pixels(void) const 
+        { 
+            return _pixels; 
+        }
+
+        uint16_t rows(void) const 
+        { 
+            return _rows; 
+        }
+
+        uint16_t cols(void) const 
+        { 
+            return _cols; 
+        }
+
+        uint16_t stride(void) const 
+        { 
+            return _stride; 
+        }
+};
+
 /**
   * Copy one image to another.
   * @param src source image
@@ -72,6 +157,19 @@ void imgCopy(uint16_t * src, uint16_t * dst, uint16_t numpix);
   */
 void imgCopy(uint8_t * src, uint8_t * dst, uint16_t numpix);
 
+/**
+  * Copies the pixels of a view into an image of the same number of rows and 
+  * columns.
+  * @param src source view
+  * @param dst destination image
+  */
+void imgCopy(ImageView<uint16_t> src, uint16_t * dst);
+
+/**
+  * Eight-bit version of above.
+  */
+void imgCopy(ImageView<uint8_t> src, uint8_t * dst);
+
 /**
   * Dumps image to serial output as ASCII characters. 
   * Darker characters correspond to brighter pixels.
@@ -100,6 +198,13 @@ void imgDumpMatlab(uint16_t * img, uint8_t numrows, uint8_t numcols);
   */
 uint16_t imgMin(uint16_t * img, uint16_t numpix);
 
+/**
+  * Gets smallest pixel value in a view.
+  * @param img image view
+  * @return minimum value
+  */
+uint16_t imgMin(ImageView<uint16_t> img);
+
 /**
   * Gets largest pixel value in image.
   * @param img image pixels
@@ -108,6 +213,13 @@ uint16_t imgMin(uint16_t * img, uint16_t numpix);
   */
 uint16_t imgMax(uint16_t * img, uint16_t numpix);
 
+/**
+  * Gets largest pixel value in a view.
+  * @param img image view
+  * @return maximum value
+  */
+uint16_t imgMax(ImageView<uint16_t> img);
+
 /**
   * Subtracts to images to produce a third: D = A - B
   * @param a pixels of image A (input)
@@ -219,6 +331,57 @@ void imgSubwin2Dto1DVertical(
         uint8_t dstnumpix, 
         uint8_t dstpixlength);
 
+/**
+ * Sums each row of a view to form a 1D image, with one pixel per row.
+ *
+ * @param src input view
+ * @param dst output image
+ */
+void imgSubwin2Dto1DHorizontal(ImageView<uint16_t> src, uint16_t * dst);
+
+/**
+ * Sums each column of a view to form a 1D image, with one pixel per column.
+ *
+ * @param src input view
+ * @param dst output image
+ */
+void imgSubwin2Dto1DVertical(ImageView<uint16_t> src, uint16_t * dst);
+
+/**
+ * Halves the size of an image by averaging each 2x2 square of pixels, rounding to 
+ * nearest.  A last odd row or column is dropped.
+ *
+ * @param src input image
+ * @param rows number of rows of src
+ * @param cols number of columns of src
+ * @param dst output image, of rows/2 rows and cols/2 columns
+ */
+void imgDownsample2x2(uint16_t * src, uint16_t rows, uint16_t cols, uint16_t * dst);
+
+/**
+ * Eight-bit version of above.
+ */
+void imgDownsample2x2(uint8_t * src, uint16_t rows, uint16_t cols, uint8_t * dst);
+
+/**
+ * Shifts an image by a fraction of a pixel or more, using bilinear interpolation
+ * in fixed point: dst(r,c) = src(r-dy, c-dx).  Pixels that would come from outside
+ * src are taken from its nearest edge.
+ *
+ * @param src input image
+ * @param rows number of rows
+ * @param cols number of columns
+ * @param dx horizontal shift in 1/256 pixel
+ * @param dy vertical shift in 1/256 pixel
+ * @param dst output image, of the same size
+ */
+void imgWarpBilinear(uint16_t * src, uint16_t rows, uint16_t cols, int32_t dx, int32_t dy, uint16_t * dst);
+
+/**
+ * Eight-bit version of above.
+ */
+void imgWarpBilinear(uint8_t * src, uint16_t rows, uint16_t cols, int32_t dx, int32_t dy, uint8_t * dst);
+
 /**
  * Calculates a fixed-pattern-noise mask for an image.
  *
@@ -252,4 +415,58 @@ void imgCalcMask(uint16_t *img, uint16_t size, uint8_t *mask, uint16_t *maskBase
  */
 void imgApplyMask(uint16_t *img, uint16_t size, uint8_t *mask, uint16_t maskBase);
 
+/**
+ * A ring of N image buffers, for keeping the most recent N images without copying
+ * them.  Each new image is acquired into the buffer returned by rotate(), which 
+ * was holding the oldest image, and the images already acquired move back one 
+ * place without any pixels moving.  For example, optical flow between the newest 
+ * image and the one k images earlier is
+ *
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>ofoLK_Square_2D(ring.current(), ring.previous(k), rows, cols, scale, &ofx, &ofy);</tt>
+ *
+ * @param T pixel type
+ * @param N number of images kept
+ * @param NUMPIX number of pixels in each image
+ */
+template <typename T, uint8_t N, uint16_t NUMPIX>
+class FrameRing {
+
+    private:
+
+        T _frames[N][NUMPIX];
+        uint8_t _current;
+
+    public:
+
+        FrameRing(void) : _current(0) { }
+
+        /**
+          * Returns the newest image.
+          * @return image pixels
+          */
+        T * current(void) 
+        { 
+            return _frames[_current]; 
+        }
+
+        /**
+          * Returns an earlier image.
+          * @param k how many images back (1 to N-1)
+          * @return image pixels
+          */
+        T * previous(uint8_t k=1) 
+        { 
+            return _frames[(_current + N - k) % N]; 
+        }
 
+        /**
+          * Retires the oldest image, making its buffer current for the next image to 
+          * be acquired.  The image that was current becomes previous(1).
+          * @return buffer for the next image
+          */
+        T * rotate(void) 
+        { 
+            _current = (_current + 1) % N; 
+            return _frames[_current]; 
+        }
+};
@@ -33,13 +33,58 @@
 #include <OpticalFlow.h>
 
 #include <stdio.h>
+#include <string.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#endif
+
+// Tables stay in RAM where there is no separate program memory
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_word
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#endif
 
 void ofoLPF(int16_t *filtered_OF, int16_t *new_OF, float alpha)
 {
     (*filtered_OF)=(*filtered_OF)+((float)(*new_OF)-(*filtered_OF))	*alpha;
 }
 
-bool ofoAccumulate(int16_t new_OF, int16_t *acc_OF, uint16_t threshold)
+// Adds the fraction of the difference given by product >> bits to a value, 
+// truncating the sum toward zero as the conversion from float in ofoLPF() does
+static inline int16_t lpf_step(int16_t value, int32_t product, uint8_t bits)
+{
+    int32_t sum = value + (product >> bits);
+
+    // the shift rounded down; round a negative sum up instead
+    if (sum < 0 && (product & (((int32_t)1 << bits) - 1)))
+        sum++;
+
+    return (int16_t)sum;
+}
+
+void ofoLPF_Q15(int16_t * filtered, const int16_t * input, uint16_t count, uint16_t alpha)
+{
+    for (uint16_t i=0; i<count; ++i)
+        filtered[i] = lpf_step(filtered[i], ((int32_t)input[i] - filtered[i]) * alpha, 15);
+}
+
+void ofoLPF_Shift(int16_t * filtered, const int16_t * input, uint16_t count, uint8_t shift)
+{
+    for (uint16_t i=0; i<count; ++i)
+        filtered[i] = lpf_step(filtered[i], (int32_t)input[i] - filtered[i], shift);
+}
+
+void ofoLPF2_Q15(int16_t * stage, int16_t * filtered, const int16_t * input, uint16_t count, uint16_t alpha)
+{
+    ofoLPF_Q15(stage, input, count, alpha);
+    ofoLPF_Q15(filtered, stage, count, alpha);
+}
+
+bool ofoAccumulate(int16_t new_OF, int16_t *acc_OF, int16_t threshold)
 {
     bool reset = false;
 
@@ -53,251 +98,808 @@ bool ofoAccumulate(int16_t new_OF, int16_t *acc_OF, uint16_t threshold)
 }
 
 
-void ofoIIA_1D(pixel_t * curr_img, pixel_t * last_img, uint16_t	numpix, uint16_t scale, uint16_t *out) 
+void ofoIIA_1D(pixel_t * curr_img, pixel_t * last_img, uint16_t numpix, uint16_t scale, int16_t *out) 
 {
-    // Set up pointers
-    pixel_t * pleft = curr_img;	    //left-shifted image
-    pixel_t * pone = curr_img+1;	//center image
-    pixel_t * pright = curr_img+2;	//right-shifted image
-    pixel_t * ptwo = last_img+1;	//time-shifted image
+    int32_t top;
+    int32_t bottom;
 
-    int32_t top    = 0;
-    int32_t bottom = 0;
+    ofo_sums_1d_wide<8*sizeof(pixel_t)>(curr_img, last_img, numpix, 1, 1, 0, &top, &bottom);
 
-    for (uint8_t i=0; i<numpix-2; ++i) 
-    {
-        int32_t deltat = (int)(*ptwo) - (int)(*pone);    // temporal gradient i.e. pixel change over time
-        int32_t deltax = (int)(*pright) - (int)(*pleft); // spatial gradient i.e. pixel change over space
-        top += deltat * deltax;
-        bottom += deltax * deltax;
-
-        // Increment pointers
-        pleft++;
-        pone++;
-        pright++;
-        ptwo++;
-    }
+    *out = ofoIIA_1D_Solve(top, bottom, scale);
+}
+
+int16_t ofoIIA_1D_Solve(int32_t top, int32_t bottom, uint16_t scale)
+{
+    // no texture, no shift
+    if (bottom == 0)
+        return 0;
 
     // Compute final output. Note use of "scale" here to multiply 2*top   
     // to a larger number so that it may be meaningfully divided using 
     // fixed point arithmetic
-    *out = 2*top*scale/bottom;
+    int64_t out = 2 * (int64_t)top * scale / bottom;
+
+    return (int16_t)(out > 32767 ? 32767 : out < -32767 ? -32767 : out);
 }
 
+// Returns the right shift that brings every sum within BITS bits of magnitude.  
+// Shifting all sums by the same amount leaves the solution unchanged.
+static uint8_t sums_shift(flowsums_t * sums, uint8_t bits)
+{
+    // find the largest magnitude among the sums
+    uint32_t biggest = 0;
+    int32_t all[5] = {sums->A11, sums->A12, sums->A22, sums->b1, sums->b2};
+    for (uint8_t i=0; i<5; ++i) {
+        uint32_t mag = all[i] < 0 ? -(uint32_t)all[i] : (uint32_t)all[i];
+        if (mag > biggest)
+            biggest = mag;
+    }
+
+    uint8_t shift = 0;
+    while (biggest >> bits) {
+        biggest >>= 1;
+        shift++;
+    }
 
-void ofoIIA_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy)
+    return shift;
+}
+
+// Returns the number of bits to which the sums must be limited so that the 
+// 64-bit products in the solvers below, multiplied by 2*scale, cannot overflow
+static uint8_t solve_bits(uint16_t scale)
 {
-    int32_t  A=0, BD=0, C=0, E=0, F=0;
+    uint8_t scalebits = 0;
+    while (scale >> scalebits)
+        scalebits++;
+
+    return (61 - scalebits) / 2;
+}
 
-    // set up pointers
-    pixel_t *f0 = curr_img + cols + 1;   // center image
-    pixel_t *f1 = curr_img + cols + 2;   // right-shifted image
-    pixel_t *f2 = curr_img + cols;       // left-shifted image	
-    pixel_t *f3 = curr_img + 2*cols + 1; // down-shifted image	
-    pixel_t *f4 = curr_img + 1;		     // up-shifted image
-    pixel_t *fz = last_img + cols + 1; 	 // time-shifted image
+uint32_t ofoConfidence(flowsums_t * sums)
+{
+    int64_t det   = (int64_t)sums->A11*sums->A22 - (int64_t)sums->A12*sums->A12;
+    int64_t trace = (int64_t)sums->A11 + sums->A22;
 
-    // loop through
-    for (uint16_t r=1; r<rows-1; ++r) { 
+    // det/trace is at most the smaller eigenvalue, which is at most A11
+    return (det > 0 && trace > 0) ? (uint32_t)(det / trace) : 0;
+}
 
-        for (uint16_t c=1; c<cols-1; ++c) { 
+// Returns false if the sums fall below the texture threshold, setting the shift
+// to zero; gets the confidence if asked for it
+static bool textured(flowsums_t * sums, uint32_t threshold, uint32_t * confidence, int16_t * ofx, int16_t * ofy)
+{
+    if (!threshold && !confidence)
+        return true;
 
-            // compute differentials, then increment pointers 
-            int16_t F2F1 = (*(f2++) - *(f1++));
-            int16_t F4F3 = (*(f4++) - *(f3++));
-            int16_t FCF0 = (*(fz++) - *(f0++));
+    uint32_t c = ofoConfidence(sums);
 
-            // update summations
-            A += (F2F1 * F2F1);
-            BD += (F4F3 * F2F1);
-            C  += (FCF0 * F2F1);                   
-            E += (F4F3 * F4F3);
-            F  += (FCF0 * F4F3);                                   
-        }
+    if (confidence)
+        *confidence = c;
 
-        f0+=2;	//move to next row of image
-        fz+=2;
-        f1+=2;
-        f2+=2;
-        f3+=2;
-        f4+=2;
+    if (c < threshold) {
+        *ofx = 0;
+        *ofy = 0;
+        return false;
     }
 
-    int64_t top1=( (int64_t)(C)*E - (int64_t)(F)*BD );
-    int64_t top2=( (int64_t)(A)*F - (int64_t)(C)*BD );
-    int64_t bottom=( (int64_t)(A)*E - (int64_t)(BD)*BD );
+    return true;
+}
+
+bool ofoLK_Solve(flowsums_t * sums, uint16_t scale, int16_t * ofx, int16_t * ofy, uint32_t threshold, uint32_t * confidence)
+{
+    if (!textured(sums, threshold, confidence, ofx, ofy))
+        return false;
+
+    uint8_t shift = sums_shift(sums, solve_bits(scale));
+
+    int32_t A11 = sums->A11 >> shift;
+    int32_t A12 = sums->A12 >> shift;
+    int32_t A22 = sums->A22 >> shift;
+    int32_t b1  = sums->b1  >> shift;
+    int32_t b2  = sums->b2  >> shift;
+
+    //determinant
+    int64_t detA = ( (int64_t)(A11)*A22 - (int64_t)(A12)*A12 );
 
     // Compute final output. Note use of "scale" here to multiply 2*top   
     // to a larger number so that it may be meaningfully divided using 
     // fixed point arithmetic
-    int64_t XS = (2*scale*top1)/bottom;
-    int64_t YS = (2*scale*top2)/bottom;
+    int64_t XS = detA == 0 ? 0 : ( (int64_t)(b1)*A22 - (int64_t)(b2)*A12 ) * scale / detA;
+    int64_t YS = detA == 0 ? 0 : ( (int64_t)(b2)*A11 - (int64_t)(b1)*A12 ) * scale / detA;
 
     (*ofx) = (int16_t)XS;
     (*ofy) = (int16_t)YS;
+
+    return detA != 0;
+}
+
+bool ofoIIA_Solve(flowsums_t * sums, uint16_t scale, int16_t * ofx, int16_t * ofy, uint32_t threshold, uint32_t * confidence)
+{
+    if (!textured(sums, threshold, confidence, ofx, ofy))
+        return false;
+
+    uint8_t shift = sums_shift(sums, solve_bits(scale));
+
+    int32_t A11 = sums->A11 >> shift;
+    int32_t A12 = sums->A12 >> shift;
+    int32_t A22 = sums->A22 >> shift;
+    int32_t b1  = sums->b1  >> shift;
+    int32_t b2  = sums->b2  >> shift;
+
+    int64_t top1=( (int64_t)(b1)*A22 - (int64_t)(b2)*A12 );
+    int64_t top2=( (int64_t)(A11)*b2 - (int64_t)(b1)*A12 );
+    int64_t bottom=( (int64_t)(A11)*A22 - (int64_t)(A12)*A12 );
+
+    // Compute final output. Note use of "scale" here to multiply 2*top   
+    // to a larger number so that it may be meaningfully divided using 
+    // fixed point arithmetic
+    int64_t XS = bottom == 0 ? 0 : (2*scale*top1)/bottom;
+    int64_t YS = bottom == 0 ? 0 : (2*scale*top2)/bottom;
+
+    (*ofx) = (int16_t)XS;
+    (*ofy) = (int16_t)YS;
+
+    return bottom != 0;
+}
+
+// Returns num/den with OFO_QBITS fractional bits, for den > 0, using a single 
+// 32-bit division for the integer part and long division for the fraction.
+// Rounds toward zero and saturates at the limits of int16_t.
+static int16_t divide_fixed(int32_t num, int32_t den)
+{
+    bool neg = num < 0;
+    uint32_t n = neg ? -(uint32_t)num : (uint32_t)num;
+    uint32_t d = (uint32_t)den;
+
+    uint32_t q = n / d;
+    uint32_t r = n % d;
+
+    if (q > (0x7FFFUL >> OFO_QBITS))
+        return neg ? -0x7FFF : 0x7FFF;
+
+    // remainder is less than den < 2^31, so it can be doubled without overflow
+    for (uint8_t i=0; i<OFO_QBITS; ++i) {
+        q <<= 1;
+        r <<= 1;
+        if (r >= d) {
+            r -= d;
+            q |= 1;
+        }
+    }
+
+    if (q > 0x7FFF)
+        q = 0x7FFF;
+
+    return neg ? -(int16_t)q : (int16_t)q;
+}
+
+// Returns the confidence of sums shifted right to fit in sixteen bits, scaled 
+// back up: the determinant was shifted twice and the trace once
+static uint32_t confidence_fixed(int16_t A11, int16_t A12, int16_t A22, uint8_t shift)
+{
+    int32_t detA  = (int32_t)A11*A22 - (int32_t)A12*A12;
+    int32_t trace = (int32_t)A11 + A22;
+
+    uint32_t c = (detA > 0 && trace > 0) ? (uint32_t)(detA / trace) : 0;
+
+    return (shift && (c >> (32-shift))) ? 0xFFFFFFFF : c << shift;
 }
 
+uint32_t ofoConfidenceFixed(flowsums_t * sums)
+{
+    // shift only the matrix sums, which are all that the confidence depends on
+    flowsums_t a = {sums->A11, sums->A12, sums->A22, 0, 0};
+    uint8_t shift = sums_shift(&a, 15);
+
+    return confidence_fixed(a.A11 >> shift, a.A12 >> shift, a.A22 >> shift, shift);
+}
+
+bool ofoLK_SolveFixed(flowsums_t * sums, int16_t * ofx, int16_t * ofy, uint32_t threshold, uint32_t * confidence)
+{
+    // shift all sums by the same amount so that they fit in sixteen bits; 
+    // the shift cancels in the quotients below
+    uint8_t shift = sums_shift(sums, 15);
+
+    int16_t A11 = sums->A11 >> shift;
+    int16_t A12 = sums->A12 >> shift;
+    int16_t A22 = sums->A22 >> shift;
+    int16_t b1  = sums->b1  >> shift;
+    int16_t b2  = sums->b2  >> shift;
+
+    // each product is less than 2^30 in magnitude, so differences fit in 32 bits
+    int32_t detA = (int32_t)A11*A22 - (int32_t)A12*A12;
+
+    if (threshold || confidence) {
+        uint32_t c = confidence_fixed(A11, A12, A22, shift);
+        if (confidence)
+            *confidence = c;
+        if (c < threshold) 
+            detA = 0;
+    }
+
+    // determinant can go slightly negative when shifting loses precision
+    if (detA <= 0) {
+        *ofx = 0;
+        *ofy = 0;
+        return false;
+    }
+
+    *ofx = divide_fixed((int32_t)b1*A22 - (int32_t)b2*A12, detA);
+    *ofy = divide_fixed((int32_t)b2*A11 - (int32_t)b1*A12, detA);
+
+    return true;
+}
+
+bool ofoIIA_SolveFixed(flowsums_t * sums, int16_t * ofx, int16_t * ofy, uint32_t threshold, uint32_t * confidence)
+{
+    int16_t x, y;
+
+    bool ok = ofoLK_SolveFixed(sums, &x, &y, threshold, confidence);
+
+    // image-interpolation shift is twice the Lucas-Kanade shift; saturate
+    *ofx = x > 0x3FFF ? 0x7FFF : x < -0x3FFF ? -0x7FFF : 2*x;
+    *ofy = y > 0x3FFF ? 0x7FFF : y < -0x3FFF ? -0x7FFF : 2*y;
 
-void ofoIIA_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy)
+    return ok;
+}
+
+void ofoSums_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, flowsums_t * sums)
 {
-    int32_t  A=0, BD=0, C=0, E=0, F=0;
+    ofoSums_Plus_2D<pixel_t>(curr_img, last_img, rows, cols, sums);
+}
 
-    // set up pointers
-    pixel_t *f0 = curr_img;             // top left 
-    pixel_t *f1 = curr_img + 1; 		// top right
-    pixel_t *f2 = curr_img + cols; 	    // bottom left
-    pixel_t *f3 = curr_img + cols + 1; 	// bottom right
-    pixel_t *fz = last_img; 		    // top left time-shifted
+void ofoSums_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, flowsums_t * sums)
+{
+    ofoSums_Square_2D<pixel_t>(curr_img, last_img, rows, cols, sums);
+}
 
-    for (uint16_t r=0; r<rows-1; ++r) { 
+bool ofoIIA_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold, uint32_t * confidence)
+{
+    return ofoIIA_Plus_2D<pixel_t>(curr_img, last_img, rows, cols, scale, ofx, ofy, threshold, confidence);
+}
 
-        for (uint16_t c=0; c<cols-1; ++c) { 
+bool ofoIIA_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold, uint32_t * confidence)
+{
+    return ofoIIA_Square_2D<pixel_t>(curr_img, last_img, rows, cols, scale, ofx, ofy, threshold, confidence);
+}
 
-            // compute differentials
-            int16_t F2F1 = ((*(f0) - *(f1)) + (*(f2) - *(f3))) ;
-            int16_t F4F3 = ((*(f0) - *(f2)) + (*(f1) - *(f3))) ;
-            int16_t FCF0 = (*(fz) - *(f0));
+bool ofoLK_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold, uint32_t * confidence)
+{
+    return ofoLK_Plus_2D<pixel_t>(curr_img, last_img, rows, cols, scale, ofx, ofy, threshold, confidence);
+}
 
-            //increment pointers
-            f0++;
-            fz++;
-            f1++;
-            f2++;
-            f3++;
+bool ofoLK_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold, uint32_t * confidence)
+{
+    return ofoLK_Square_2D<pixel_t>(curr_img, last_img, rows, cols, scale, ofx, ofy, threshold, confidence);
+}
 
-            // update summations
-            A += (F2F1 * F2F1);
-            BD += (F4F3 * F2F1);
-            C  += (FCF0 * F2F1);                   
-            E += (F4F3 * F4F3);
-            F  += (FCF0 * F4F3);                                   
+void ofoIntegralSums(const FlowSums<uint32_t> * sat, uint16_t cols, 
+        uint16_t row0, uint16_t col0, uint16_t row1, uint16_t col1, flowsums_t * sums)
+{
+    const FlowSums<uint32_t> * a = sat + (uint32_t)row0*(cols+1) + col0;   // upper left
+    const FlowSums<uint32_t> * b = sat + (uint32_t)row0*(cols+1) + col1;   // upper right
+    const FlowSums<uint32_t> * c = sat + (uint32_t)row1*(cols+1) + col0;   // lower left
+    const FlowSums<uint32_t> * d = sat + (uint32_t)row1*(cols+1) + col1;   // lower right
+
+    // differences modulo 2^32 are exact even when the tables have wrapped around
+    sums->A11 = (int32_t)(d->A11 - b->A11 - c->A11 + a->A11);
+    sums->A12 = (int32_t)(d->A12 - b->A12 - c->A12 + a->A12);
+    sums->A22 = (int32_t)(d->A22 - b->A22 - c->A22 + a->A22);
+    sums->b1  = (int32_t)(d->b1  - b->b1  - c->b1  + a->b1);
+    sums->b2  = (int32_t)(d->b2  - b->b2  - c->b2  + a->b2);
+}
+
+void ofoLK_Grid(const FlowSums<uint32_t> * sat, uint16_t rows, uint16_t cols, uint8_t method,
+        uint16_t patchsize, uint16_t step, uint16_t scale, int16_t * ofx, int16_t * ofy)
+{
+    bool square = method == OFO_IIA_SQUARE || method == OFO_LK_SQUARE;
+    bool iia    = method == OFO_IIA_PLUS   || method == OFO_IIA_SQUARE;
+
+    if (patchsize == 0)
+        return;
+
+    // patches side by side, rather than a grid that never advances
+    if (step == 0)
+        step = patchsize;
+
+    // products within a patch: all but the last row and column for square, 
+    // all but the border for plus
+    uint16_t lo = square ? 0 : 1;
+    uint16_t hi = patchsize - 1;
+
+    for (uint16_t row=0; row+patchsize<=rows; row+=step) {
+
+        for (uint16_t col=0; col+patchsize<=cols; col+=step) {
+
+            flowsums_t sums;
+            ofoIntegralSums(sat, cols, row+lo, col+lo, row+hi, col+hi, &sums);
+
+            if (iia)
+                ofoIIA_Solve(&sums, scale, ofx++, ofy++);
+            else
+                ofoLK_Solve(&sums, scale, ofx++, ofy++);
         }
+    }
+}
 
-        //go to next row
-        f0++;
-        fz++;
-        f1++;
-        f2++;
-        f3++;
+#if defined(__GNUC__) && !defined(__AVR__)
+
+// Number of bits that differ between n signatures and n others; on host computers, 
+// eight signatures at a time with a single popcount
+static uint32_t hamming_row(const uint8_t * a, const uint8_t * b, uint16_t n)
+{
+    uint32_t count = 0;
+    uint16_t c = 0;
+
+    for (; c+8<=n; c+=8) {
+        uint64_t x, y;
+        memcpy(&x, a+c, 8);
+        memcpy(&y, b+c, 8);
+        count += __builtin_popcountll(x ^ y);
     }
 
-    int64_t top1=( (int64_t)(C)*E - (int64_t)(F)*BD );
-    int64_t top2=( (int64_t)(A)*F - (int64_t)(C)*BD );
-    int64_t bottom=( (int64_t)(A)*E - (int64_t)(BD)*BD );
+    for (; c<n; ++c)
+        count += __builtin_popcount(a[c] ^ b[c]);
 
-    // Compute final output. Note use of "scale" here to multiply 2*top   
-    // to a larger number so that it may be meaningfully divided using 
-    // fixed point arithmetic
-    int64_t XS = (2*scale*top1)/bottom;
-    int64_t YS = (2*scale*top2)/bottom;
+    return count;
+}
 
-    (*ofx) = (int16_t)XS;
-    (*ofy) = (int16_t)YS;
+#else
+
+// On the Arduino, a byte at a time from a table of the bits in each nibble, 
+// which is much faster than counting the bits one by one
+static const uint8_t NIBBLE_BITS[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+static uint32_t hamming_row(const uint8_t * a, const uint8_t * b, uint16_t n)
+{
+    uint32_t count = 0;
+
+    for (uint16_t c=0; c<n; ++c) {
+        uint8_t x = a[c] ^ b[c];
+        count += NIBBLE_BITS[x & 0x0F] + NIBBLE_BITS[x >> 4];
+    }
+
+    return count;
 }
 
-void ofoLK_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy)
+#endif
+
+// Number of bits that differ between the signatures of the current image and 
+// those of the previous image displaced by (dx,dy), over the pixels that stay 
+// inside the previous image for every displacement within range
+static uint32_t hamming_cost(const uint8_t * curr, const uint8_t * last, uint16_t rows, uint16_t cols, 
+        uint16_t range, int16_t dx, int16_t dy)
 {
-    int32_t  A11=0, A12=0, A22=0, b1=0, b2=0;
-    int16_t  F2F1, F4F3, FCF0;
+    uint32_t cost = 0;
+
+    const uint16_t n = cols - 2*range;
 
-    // set up pointers
-    pixel_t *f0 = curr_img + cols + 1;   // center image
-    pixel_t *f1 = curr_img + cols + 2;   // right-shifted image
-    pixel_t *f2 = curr_img + cols;       // left-shifted image	
-    pixel_t *f3 = curr_img + 2*cols + 1; // down-shifted image	
-    pixel_t *f4 = curr_img + 1;		     // up-shifted image
-    pixel_t *fz = last_img + cols + 1; 	 // time-shifted image
+    for (uint16_t r=range; r<rows-range; ++r)
+        cost += hamming_row(curr + (uint32_t)r*cols + range, last + (uint32_t)(r-dy)*cols + range - dx, n);
 
-    for (uint16_t r=1; r<rows-1; ++r) { 
+    return cost;
+}
 
-        for (uint16_t c=1; c<cols-1; ++c) { 
+// Offset of the minimum of a parabola through (-1,cm), (0,c0), (1,cp), scaled
+static int32_t parabola_peak(uint32_t cm, uint32_t c0, uint32_t cp, uint16_t scale)
+{
+    int32_t den = 2 * ((int32_t)cm + (int32_t)cp - 2*(int32_t)c0);
 
-            // compute differentials, then increment pointers (post-increment)
-            F2F1 = (*(f2++) - *(f1++));	//horizontal differential
-            F4F3 = (*(f4++) - *(f3++));	//vertical differential
-            FCF0 = (*(fz++) - *(f0++));	//time differential
+    return den > 0 ? ((int32_t)cm - (int32_t)cp) * scale / den : 0;
+}
 
-            // update summations
-            A11 += (F2F1 * F2F1);
-            A12 += (F4F3 * F2F1);
-            A22 += (F4F3 * F4F3);
-            b1  += (FCF0 * F2F1);                   
-            b2  += (FCF0 * F4F3);                                   
+void ofoHamming_2D(const uint8_t * curr_census, const uint8_t * last_census, uint16_t rows, uint16_t cols, 
+        uint8_t range, uint16_t scale, int16_t * ofx, int16_t * ofy)
+{
+    *ofx = 0;
+    *ofy = 0;
+
+    // skip the border, whose signatures are zero, as well as the search range
+    const uint16_t margin = range + 1;
+
+    if (rows <= 2*margin || cols <= 2*margin)
+        return;
+
+    // favor zero motion when displacements tie, as in a featureless image
+    int16_t bx = 0;
+    int16_t by = 0;
+    uint32_t best = hamming_cost(curr_census, last_census, rows, cols, margin, 0, 0);
+
+    for (int16_t dy=-range; dy<=range; ++dy) {
+        for (int16_t dx=-range; dx<=range; ++dx) {
+            uint32_t cost = hamming_cost(curr_census, last_census, rows, cols, margin, dx, dy);
+            if (cost < best) {
+                best = cost;
+                bx = dx;
+                by = dy;
+            }
         }
-        f0+=2;	//move to next row of image
-        fz+=2;
-        f1+=2;
-        f2+=2;
-        f3+=2;
-        f4+=2;
     }
 
-    //determinant
-    int64_t detA = ( (int64_t)(A11)*A22 - (int64_t)(A12)*A12 );
+    // motion d from previous to current image: curr(x) = last(x - d)
+    int32_t mx = (int32_t)bx * scale;
+    int32_t my = (int32_t)by * scale;
 
-    // Compute final output. Note use of "scale" here to multiply 2*top   
-    // to a larger number so that it may be meaningfully divided using 
-    // fixed point arithmetic
-    int64_t XS = detA == 0 ? 0 : ( (int64_t)(b1)*A22 - (int64_t)(b2)*A12 ) * scale / detA;
-    int64_t YS = detA == 0 ? 0 : ( (int64_t)(b2)*A11 - (int64_t)(b1)*A12 ) * scale / detA;
+    // no refinement at the edge of the search range, where a neighbor is missing
+    if (bx > -range && bx < range)
+        mx += parabola_peak(
+                hamming_cost(curr_census, last_census, rows, cols, margin, bx-1, by), best,
+                hamming_cost(curr_census, last_census, rows, cols, margin, bx+1, by), scale);
 
-    (*ofx) = (int16_t)XS;
-    (*ofy) = (int16_t)YS;
+    if (by > -range && by < range)
+        my += parabola_peak(
+                hamming_cost(curr_census, last_census, rows, cols, margin, bx, by-1), best,
+                hamming_cost(curr_census, last_census, rows, cols, margin, bx, by+1), scale);
+
+    // image-interpolation shift is minus the motion
+    *ofx = (int16_t)-mx;
+    *ofy = (int16_t)-my;
 }
 
-void ofoLK_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows,uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy)
+bool ofoEgomotion(const int16_t * ofx, const int16_t * ofy, const bool * valid, uint8_t gridrows, uint8_t gridcols, 
+        Egomotion * ego)
 {
-    int32_t  A11=0, A12=0, A22=0, b1=0, b2=0;
+    // positions are in half spacings, so that the center of the grid is at a whole
+    // number; sums of positions and of their products with flows
+    int32_t n = 0, sx = 0, sy = 0, sxx = 0;
+    int32_t su = 0, sv = 0;
+    int64_t sp = 0, sq = 0;
+
+    for (uint8_t r=0; r<gridrows; ++r) {
 
-    // set up pointers
-    pixel_t *f0 = curr_img;             // top left 
-    pixel_t *f1 = curr_img + 1; 		// top right
-    pixel_t *f2 = curr_img + cols; 	    // bottom left
-    pixel_t *f3 = curr_img + cols + 1; 	// bottom right
-    pixel_t *fz = last_img; 		    // top left time-shifted
+        int16_t y = 2*r - (gridrows-1);
 
-    // loop through
-    for (uint16_t r=0; r<rows-1; ++r) { 
+        for (uint8_t c=0; c<gridcols; ++c) {
 
-        for (uint16_t c=0; c<cols-1; ++c) { 
+            uint16_t i = (uint16_t)r*gridcols + c;
 
-            // compute differentials      
-            int16_t F2F1 = ((*(f0) - *(f1)) + (*(f2) - *(f3))) ;
-            int16_t F4F3 = ((*(f0) - *(f2)) + (*(f1) - *(f3))) ;
-            int16_t FCF0 = (*(fz) - *(f0));
+            if (valid && !valid[i])
+                continue;
 
-            //increment pointers
-            f0++;
-            fz++;
-            f1++;
-            f2++;
-            f3++;
+            int16_t x = 2*c - (gridcols-1);
+            int16_t u = ofx[i];
+            int16_t v = ofy[i];
 
-            // update summations
-            A11 += (F2F1 * F2F1);
-            A12 += (F4F3 * F2F1);
-            A22 += (F4F3 * F4F3);
-            b1  += (FCF0 * F2F1);                   
-            b2  += (FCF0 * F4F3);                                   
+            n++;
+            sx  += x;
+            sy  += y;
+            sxx += (int32_t)x*x + (int32_t)y*y;
+            su  += u;
+            sv  += v;
+            sp  += (int32_t)x*u + (int32_t)y*v;     // expansion
+            sq  += (int32_t)x*v - (int32_t)y*u;     // rotation
         }
+    }
+
+    // eliminating the translation from the normal equations leaves divergence and 
+    // rotation independent, each with this denominator
+    int64_t den = (int64_t)n*sxx - (int64_t)sx*sx - (int64_t)sy*sy;
+
+    if (den <= 0)
+        return false;
+
+    // two half spacings per spacing
+    int64_t d = (n*sp - (int64_t)sx*su - (int64_t)sy*sv) * (2 << OFO_QBITS) / den;
+    int64_t w = (n*sq - (int64_t)sx*sv + (int64_t)sy*su) * (2 << OFO_QBITS) / den;
+
+    ego->divergence = (int32_t)d;
+    ego->rotation   = (int32_t)w;
+
+    // translation is what remains of the average flow at the average position
+    ego->tx = (int16_t)((su - ((int64_t)sx*d - (int64_t)sy*w) / (2 << OFO_QBITS)) / n);
+    ego->ty = (int16_t)((sv - ((int64_t)sy*d + (int64_t)sx*w) / (2 << OFO_QBITS)) / n);
+
+    return true;
+}
 
-        //go to next row
-        f0++;
-        fz++;
-        f1++;
-        f2++;
-        f3++;
+bool ofoFocusOfExpansion(const Egomotion * ego, int32_t * foex, int32_t * foey)
+{
+    const int64_t d = ego->divergence;
+    const int64_t w = ego->rotation;
+
+    int64_t den = d*d + w*w;
+
+    if (den == 0)
+        return false;
+
+    // solve tx + d*x - w*y = 0, ty + d*y + w*x = 0
+    *foex = (int32_t)(-(d*ego->tx + w*ego->ty) * (1 << (2*OFO_QBITS)) / den);
+    *foey = (int32_t)(-(d*ego->ty - w*ego->tx) * (1 << (2*OFO_QBITS)) / den);
+
+    return true;
+}
+
+bool ofoTimeToContact(const Egomotion * ego, int16_t flowscale, uint16_t spacing, int32_t * frames)
+{
+    // expansion per frame is divergence / (flowscale * spacing)
+    int64_t num = (int64_t)flowscale * spacing * (1 << (2*OFO_QBITS));
+
+    if (ego->divergence == 0 || (num > 0) != (ego->divergence > 0))
+        return false;
+
+    *frames = (int32_t)(num / ego->divergence);
+
+    return true;
+}
+
+uint8_t ofoTuningCheck(const FlowTuning * tuning)
+{
+    // sum of the bytes before the check byte, offset so that erased EEPROM 
+    // (all ones) and zeroed memory do not pass
+    const uint8_t * bytes = (const uint8_t *)tuning;
+    uint8_t sum = 0xA5;
+
+    for (uint8_t k=0; k<offsetof(FlowTuning, check); ++k)
+        sum += bytes[k];
+
+    return sum;
+}
+
+// Checks that a loaded tuning is intact and for images of this size
+static bool tuning_valid(const FlowTuning * tuning, uint16_t rows, uint16_t cols)
+{
+    return tuning->check == ofoTuningCheck(tuning) && tuning->rows == rows && tuning->cols == cols &&
+        tuning->method <= OFO_LK_SQUARE;
+}
+
+#if defined(__AVR__)
+
+bool ofoTuningLoad(FlowTuning * tuning, uint16_t rows, uint16_t cols, uint16_t where)
+{
+    eeprom_read_block(tuning, (const void *)where, sizeof(FlowTuning));
+    return tuning_valid(tuning, rows, cols);
+}
+
+bool ofoTuningSave(const FlowTuning * tuning, uint16_t where)
+{
+    // writes only the bytes that changed, to spare the EEPROM
+    eeprom_update_block(tuning, (void *)where, sizeof(FlowTuning));
+    return true;
+}
+
+#elif defined(ARDUINO)
+
+bool ofoTuningLoad(FlowTuning * tuning, uint16_t rows, uint16_t cols, uint16_t where)
+{
+    (void)tuning;
+    (void)rows;
+    (void)cols;
+    (void)where;
+
+    return false;
+}
+
+bool ofoTuningSave(const FlowTuning * tuning, uint16_t where)
+{
+    (void)tuning;
+    (void)where;
+
+    return false;
+}
+
+#else
+
+bool ofoTuningLoad(FlowTuning * tuning, uint16_t rows, uint16_t cols, const char * where)
+{
+    FILE * fp = fopen(where, "rb");
+
+    if (!fp)
+        return false;
+
+    bool ok = fread(tuning, sizeof(FlowTuning), 1, fp) == 1;
+
+    fclose(fp);
+
+    return ok && tuning_valid(tuning, rows, cols);
+}
+
+bool ofoTuningSave(const FlowTuning * tuning, const char * where)
+{
+    FILE * fp = fopen(where, "wb");
+
+    if (!fp)
+        return false;
+
+    bool ok = fwrite(tuning, sizeof(FlowTuning), 1, fp) == 1;
+
+    return fclose(fp) == 0 && ok;
+}
+
+#endif
+
+// Cosines of 2*pi*m/64 for m from 0 to 16, with 15 fractional bits; the other
+// quarters of the circle follow by symmetry
+static const int16_t QUARTER_COS[17] PROGMEM = {
+    32767, 32609, 32137, 31356, 30273, 28898, 27245, 25329, 
+    23170, 20787, 18204, 15446, 12539,  9512,  6393,  3212, 0
+};
+
+// Cosine of 2*pi*m/64, for m from 0 to 63
+static int16_t cos64(uint8_t m)
+{
+    int16_t q;
+
+    if (m <= 16)
+        return (int16_t)pgm_read_word(&QUARTER_COS[m]);
+
+    if (m <= 32) 
+        q = (int16_t)pgm_read_word(&QUARTER_COS[32-m]);
+    else if (m <= 48)
+        q = (int16_t)pgm_read_word(&QUARTER_COS[m-32]);
+    else
+        return (int16_t)pgm_read_word(&QUARTER_COS[64-m]);
+
+    return -q;
+}
+
+int16_t ofo_hann(uint8_t i, uint8_t n)
+{
+    // (1 - cos(2*pi*i/n)) / 2
+    return (int16_t)((32767 - (int32_t)cos64((uint8_t)(i * (64/n)))) >> 1);
+}
+
+// In-place fixed-point FFT of n values spaced by stride, halving the values at 
+// each stage so they cannot overflow; the result is the transform divided by n
+static void fft(int16_t * re, int16_t * im, uint8_t n, uint8_t stride)
+{
+    // bit-reversed order
+    for (uint8_t i=1, j=0; i<n; ++i) {
+        uint8_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            int16_t t;
+            t = re[i*stride]; re[i*stride] = re[j*stride]; re[j*stride] = t;
+            t = im[i*stride]; im[i*stride] = im[j*stride]; im[j*stride] = t;
+        }
     }
 
-    //compute determinant
-    int64_t detA = ( (int64_t)(A11)*A22 - (int64_t)(A12)*A12 );
+    for (uint8_t len=2; len<=n; len<<=1) {
 
-    // Compute final output. Note use of "scale" here to multiply 2*top   
-    // to a larger number so that it may be meaningfully divided using 
-    // fixed point arithmetic
-    int64_t XS = detA == 0 ? 0 : ( (int64_t)(b1)*A22 - (int64_t)(b2)*A12 ) * scale / detA;
-    int64_t YS = detA == 0 ? 0 : ( (int64_t)(b2)*A11 - (int64_t)(b1)*A12 ) * scale / detA;
+        uint8_t step = 64 / len;
 
-    (*ofx) = (int16_t)XS;
-    (*ofy) = (int16_t)YS;
+        for (uint8_t i=0; i<n; i+=len) {
+
+            for (uint8_t k=0; k<len/2; ++k) {
+
+                // twiddle exp(-2*pi*i*k/len)
+                int32_t wr = cos64(k*step);
+                int32_t wi = -(int32_t)cos64((uint8_t)((k*step + 48) & 63));
+
+                int16_t * ar = re + (i+k)*stride;
+                int16_t * ai = im + (i+k)*stride;
+                int16_t * br = re + (i+k+len/2)*stride;
+                int16_t * bi = im + (i+k+len/2)*stride;
+
+                int32_t tr = (wr * *br - wi * *bi) >> 15;
+                int32_t ti = (wr * *bi + wi * *br) >> 15;
+
+                *br = (int16_t)((*ar - tr) >> 1);
+                *bi = (int16_t)((*ai - ti) >> 1);
+                *ar = (int16_t)((*ar + tr) >> 1);
+                *ai = (int16_t)((*ai + ti) >> 1);
+            }
+        }
+    }
+}
+
+static void fft_2d(int16_t * re, int16_t * im, uint8_t n)
+{
+    for (uint8_t r=0; r<n; ++r)
+        fft(re + r*n, im + r*n, n, 1);
+
+    for (uint8_t c=0; c<n; ++c)
+        fft(re + c, im + c, n, n);
+}
+
+// Scales values up to use at least fourteen bits, to keep precision through the FFT
+static void normalize(int16_t * v, uint16_t count)
+{
+    int16_t most = 0;
+
+    for (uint16_t i=0; i<count; ++i) {
+        int16_t a = v[i] < 0 ? -v[i] : v[i];
+        if (a > most)
+            most = a;
+    }
+
+    if (!most)
+        return;
+
+    uint8_t shift = 0;
+    while ((most << shift) < 0x2000)
+        shift++;
+
+    for (uint16_t i=0; i<count; ++i)
+        v[i] = (int16_t)(v[i] * (1 << shift));
+}
+
+// Offset of a correlation peak from its largest value c0, given its neighbors cm
+// (at -1) and cp (at +1), scaled, from the parabola through the three.  The 
+// windows have been aligned to the nearest pixel by then, so the peak is nearly 
+// symmetric; the ratio of the two largest samples (Foroosh et al. 2002) is exact 
+// only without a window, and with one is biased away from zero by a fifth of a 
+// pixel.
+static int32_t peak_offset(int32_t cm, int32_t c0, int32_t cp, uint16_t scale)
+{
+    int32_t den = 2 * (2*c0 - cm - cp);
+
+    if (den <= 0)
+        return 0;
+
+    return (int32_t)((int64_t)(cp - cm) * scale / den);
+}
+
+void ofo_phase_corr(int16_t * work, uint8_t n, uint16_t scale, int16_t * ofx, int16_t * ofy)
+{
+    const uint16_t nn = (uint16_t)n*n;
+
+    int16_t * re1 = work;
+    int16_t * im1 = work + nn;
+    int16_t * re2 = work + 2*nn;
+    int16_t * im2 = work + 3*nn;
+
+    normalize(re1, nn);
+    normalize(re2, nn);
+
+    fft_2d(re1, im1, n);
+    fft_2d(re2, im2, n);
+
+    // cross-power spectrum with its magnitude divided out, leaving the phase 
+    // difference at each frequency with 14 fractional bits; it goes in conjugated,
+    // so that a forward FFT gives the inverse transform
+    for (uint16_t i=0; i<nn; ++i) {
+
+        int32_t cr = (int32_t)re1[i]*re2[i] + (int32_t)im1[i]*im2[i];
+        int32_t ci = (int32_t)im1[i]*re2[i] - (int32_t)re1[i]*im2[i];
+
+        // magnitude within 7% by max + 3/8 min, avoiding a square root
+        uint32_t ar = cr < 0 ? -cr : cr;
+        uint32_t ai = ci < 0 ? -ci : ci;
+        uint32_t mag = ar > ai ? ar + (3*(ai>>3)) : ai + (3*(ar>>3));
+
+        // frequencies with too little energy have no usable phase
+        if (mag < 16) {
+            re1[i] = 0;
+            im1[i] = 0;
+            continue;
+        }
+
+        // divide by mag/2^14 rather than multiplying first, to stay within 32 bits
+        uint32_t div = (mag >> 14) + 1;
+        int32_t pr = cr / (int32_t)div;
+        int32_t pi = ci / (int32_t)div;
+        int32_t pm = (int32_t)(mag / div);
+
+        re1[i] = (int16_t)(pr * (1 << 14) / pm);
+        im1[i] = (int16_t)(-(pi * (1 << 14) / pm));
+    }
+
+    fft_2d(re1, im1, n);
+
+    // the peak of the correlation is at the motion d, where curr(x) = last(x - d)
+    uint16_t best = 0;
+    for (uint16_t i=1; i<nn; ++i)
+        if (re1[i] > re1[best])
+            best = i;
+
+    uint8_t br = best / n;
+    uint8_t bc = best % n;
+
+    int32_t c0 = re1[best];
+    int32_t mx = (bc < n/2 ? bc : bc - n) * (int32_t)scale;
+    int32_t my = (br < n/2 ? br : br - n) * (int32_t)scale;
+
+    // the correlation wraps around
+    mx += peak_offset(re1[br*n + (bc+n-1)%n], c0, re1[br*n + (bc+1)%n], scale);
+    my += peak_offset(re1[((br+n-1)%n)*n + bc], c0, re1[((br+1)%n)*n + bc], scale);
+
+    // image-interpolation shift is minus the motion
+    *ofx = (int16_t)-mx;
+    *ofy = (int16_t)-my;
 }
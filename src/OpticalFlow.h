@@ -33,10 +33,85 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 
-// Choose one
+#include "ImageUtils.h"
+
+// Pixel type for the non-templated functions below.  The templated versions
+// at the end of this file accept any integer pixel type.
 typedef uint8_t  pixel_t;
-//typedef uint16_t pixel_t;
+
+/**
+ * Optical-flow methods, numbered as in the Flow example
+ */
+static const uint8_t OFO_IIA_PLUS   = 0;
+static const uint8_t OFO_IIA_SQUARE = 1;
+static const uint8_t OFO_LK_PLUS    = 2;
+static const uint8_t OFO_LK_SQUARE  = 3;
+
+/**
+ * Gradient-product sums accumulated over an image by the two-dimensional
+ * methods.  The image-interpolation (IIA) and Lucas-Kanade (LK) methods
+ * accumulate the same sums and differ only in how they are solved.
+ *
+ * @param A integer type of the sums
+ */
+template <typename A>
+struct FlowSums {
+
+    A A11; // horizontal * horizontal
+    A A12; // vertical * horizontal
+    A A22; // vertical * vertical
+    A b1;  // temporal * horizontal
+    A b2;  // temporal * vertical
+};
+
+/**
+ * The sums as passed to the solvers
+ */
+typedef FlowSums<int32_t> flowsums_t;
+
+// Chooses type T if C is true, F otherwise (<type_traits> is not available on AVR)
+template <bool C, typename T, typename F> struct ofo_if { typedef T type; };
+template <typename T, typename F> struct ofo_if<false, T, F> { typedef F type; };
+
+/**
+ * Chooses, at compile time, the narrowest integer types that can safely hold the 
+ * pixel differentials and the sums of their products over an image.
+ *
+ * @param BITS number of bits spanned by pixel values; e.g. 8 for uint8_t pixels, 
+ *        10 for raw pixels from the Arduino ADC, 11 for Stonyman images after 
+ *        imgApplyMask (pixel differences are computed modulo 2^16, so masked images
+ *        that wrap below zero behave as signed values)
+ * @param AREA number of pixels over which the sums are accumulated
+ * @param SQUARE true for the square pixel configuration, whose spatial differentials 
+ *        span twice the range of the plus configuration's
+ */
+template <uint8_t BITS, uint32_t AREA, bool SQUARE>
+struct ofoAccumulator {
+
+    static_assert(BITS >= 1 && BITS <= 16, "pixels must span 1 to 16 bits");
+    static_assert(AREA >= 1, "image must contain at least one pixel");
+
+    // largest magnitude of a differential, and of a sum of AREA products of two
+    static const uint64_t DMAX = (SQUARE ? 2 : 1) * ((1ULL<<BITS) - 1);
+    static const uint64_t SMAX = DMAX * DMAX * AREA;
+
+    static_assert(SMAX / AREA / DMAX == DMAX && SMAX <= 0x7FFFFFFFFFFFFFFFULL, "sums cannot fit in 64 bits");
+
+    /** type for pixel differentials */
+    typedef typename ofo_if<DMAX <= 0x7FFF, int16_t, int32_t>::type diff_type;
+
+    /** type for sums */
+    typedef typename ofo_if<SMAX <= 0x7FFF, int16_t, 
+            typename ofo_if<SMAX <= 0x7FFFFFFF, int32_t, int64_t>::type>::type type;
+};
+
+/**
+ * Number of fractional bits in the shifts output by the fixed-point solvers
+ */
+static const uint8_t OFO_QBITS = 8;
 
 /**
  *	Changes current optical flow value by low-pass filter with new.
@@ -47,6 +122,56 @@ typedef uint8_t  pixel_t;
  */
 void ofoLPF(int16_t *filtered_OF, int16_t *new_OF, float alpha);
 
+/**
+ * Converts a low-pass filter parameter to the fixed-point form taken by 
+ * ofoLPF_Q15() and ofoLPF2_Q15(), at compile time; e.g. ofoAlphaQ15(0.35) is 11469.
+ *
+ * @param alpha filter parameter (between 0 and 1)
+ * @return alpha with 15 fractional bits
+ */
+constexpr uint16_t ofoAlphaQ15(double alpha)
+{
+    return (uint16_t)(alpha * 32768 + 0.5);
+}
+
+/**
+ *	Low-pass filters an array of optical flow values (e.g. the X and Y shifts of 
+ *	a grid of patches) in fixed point, as ofoLPF() does for one value without 
+ *	floating point.  Rounding alpha to 15 bits changes it by at most 2^-16, which 
+ *	changes each step by that much of the difference between the input and the 
+ *	filtered value; the changes accumulate, so the result for each value differs 
+ *	from ofoLPF()'s by at most one count plus R/(65536*alpha) counts, where R is 
+ *	the range of the input (largest less smallest).  That is one count for inputs 
+ *	spanning less than 65536*alpha, but about 21 counts for full-scale input with 
+ *	an alpha of 0.05.
+ *
+ *  @param filtered filtered optical-flow values
+ *  @param input new optical-flow values
+ *  @param count number of values
+ *  @param alpha filter parameter with 15 fractional bits (see ofoAlphaQ15)
+ */
+void ofoLPF_Q15(int16_t * filtered, const int16_t * input, uint16_t count, uint16_t alpha);
+
+/**
+ *	Same as above, with a filter parameter of 2^-shift (e.g. a shift of 2 for 0.25),
+ *	which needs no multiplication.  The result is exactly that of ofoLPF() with the
+ *	same alpha.
+ */
+void ofoLPF_Shift(int16_t * filtered, const int16_t * input, uint16_t count, uint8_t shift);
+
+/**
+ *	Second-order low-pass filter of an array of optical flow values: two of the 
+ *	filters of ofoLPF_Q15() in series, which smooths noise more strongly for the 
+ *	same delay and never overshoots.
+ *
+ *  @param stage output of first filter for each value, kept between calls
+ *  @param filtered filtered optical-flow values
+ *  @param input new optical-flow values
+ *  @param count number of values
+ *  @param alpha filter parameter of each stage, with 15 fractional bits
+ */
+void ofoLPF2_Q15(int16_t * stage, int16_t * filtered, const int16_t * input, uint16_t count, uint16_t alpha);
+
 /**
  *	Adds new optical flow value to accumulation sum iff only new value 
  *  falls outside threshold.
@@ -81,7 +206,17 @@ bool ofoAccumulate(int16_t new_OF, int16_t *acc_OF, int16_t threshold);
  *	@param scale value of one pixel of motion (for scaling output)
  *	@param out pointer to integer value for output.
  */
-void ofoIIA_1D(pixel_t * curr_img, pixel_t * last_img, uint8_t numpix, uint16_t scale, int16_t *out);
+void ofoIIA_1D(pixel_t * curr_img, pixel_t * last_img, uint16_t numpix, uint16_t scale, int16_t *out);
+
+/**
+ *	Solves for the shift from sums accumulated by the one-dimensional image 
+ *	interpolation algorithm, for ofoIIA_1D() and ofoIIA_1D_Batch().
+ *	@param top sum of products of temporal and spatial differentials
+ *	@param bottom sum of squared spatial differentials
+ *	@param scale value of one pixel of motion (for scaling output)
+ *	@return shift, or zero if bottom is zero (no texture)
+ */
+int16_t ofoIIA_1D_Solve(int32_t top, int32_t bottom, uint16_t scale);
 
 /**
  *  Runs a two-dimensional version of the Srinivasan algorithm, using a plus-shaped configuration of pixels
@@ -93,14 +228,19 @@ void ofoIIA_1D(pixel_t * curr_img, pixel_t * last_img, uint8_t numpix, uint16_t
  *	@param scale value of one pixel of motion (for scaling output)
  *	@param ofx pointer to integer value for X shift.
  *	@param ofy pointer to integer value for Y shift.
+ *	@param threshold if nonzero, patches whose confidence (see ofoConfidence) is below 
+ *	this are treated as having no texture: the shift is set to zero without solving
+ *	@param confidence if not NULL, gets the confidence
+ *	@return false if the shift was set to zero for lack of texture
  */
-
-void ofoIIA_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale,int16_t * ofx,int16_t * ofy);
+bool ofoIIA_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
 
 /**
  * Same as above, using square configuration
  */
-void ofoIIA_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale,int16_t * ofx,int16_t * ofy);
+bool ofoIIA_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
 
 /**
  *	Computes optical flow in plus configuration between two images using the algorithm desribed in
@@ -130,10 +270,2347 @@ void ofoIIA_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uin
  *	@param scale value of one pixel of motion (for scaling output)
  *	@param ofx pointer to integer value for X shift.
  *	@param ofy pointer to integer value for Y shift.
+ *	@param threshold if nonzero, patches whose confidence (see ofoConfidence) is below 
+ *	this are treated as having no texture: the shift is set to zero without solving
+ *	@param confidence if not NULL, gets the confidence
+ *	@return false if the shift was set to zero for lack of texture
+ */
+bool ofoLK_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
+
+/**
+ * Same as above, using square pixel configuration
+ */
+bool ofoLK_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
+
+/**
+ *  Accumulates the gradient-product sums used by ofoIIA_Plus_2D and ofoLK_Plus_2D, so 
+ *  that they can be passed to a solver of your choice.
+ *
+ *	@param curr_img pixels of current image
+ *	@param last_img pixels of previous image
+ *	@param rows number of rows in image
+ *	@param cols number of cols in image
+ *	@param sums gets the sums
  */
-void ofoLK_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy);
+void ofoSums_Plus_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, flowsums_t * sums);
 
 /**
  * Same as above, using square pixel configuration
  */
-void ofoLK_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, uint16_t scale,int16_t * ofx,int16_t * ofy);
+void ofoSums_Square_2D(pixel_t * curr_img, pixel_t * last_img, uint16_t rows, uint16_t cols, flowsums_t * sums);
+
+/**
+ *  Computes the confidence of the flow from a patch: the determinant of the 2x2 
+ *  system divided by its trace, which lies between half the smaller eigenvalue and 
+ *  the smaller eigenvalue.  This is large only when the patch has texture in two 
+ *  directions; patches without texture, or with texture in only one direction 
+ *  (the aperture problem), give little or no confidence.
+ *
+ *	@param sums accumulated gradient-product sums
+ *	@return confidence, in the units of the sums
+ */
+uint32_t ofoConfidence(flowsums_t * sums);
+
+/**
+ *  Same as ofoConfidence, using only 32-bit arithmetic.  The matrix sums are first
+ *  shifted right by a shared amount so that they fit in sixteen bits, as in 
+ *  ofoLK_SolveFixed, which avoids the 64-bit multiplies and division of 
+ *  ofoConfidence.  Sums below 2^15 give exactly the same confidence; larger ones,
+ *  shifted by k bits, give a confidence within 3 * 2^k of it.
+ *
+ *	@param sums accumulated gradient-product sums
+ *	@return confidence, in the units of the sums
+ */
+uint32_t ofoConfidenceFixed(flowsums_t * sums);
+
+/**
+ *  Solves for the X and Y shift from sums accumulated using the Lucas-Kanade method.  
+ *  Useful when the sums have been accumulated elsewhere, e.g. during image acquisition.
+ *  Outputs zero shift when the system is singular (no texture).
+ *
+ *	@param sums accumulated gradient-product sums
+ *	@param scale value of one pixel of motion (for scaling output)
+ *	@param ofx pointer to integer value for X shift.
+ *	@param ofy pointer to integer value for Y shift.
+ *	@param threshold if nonzero, patches whose confidence (see ofoConfidence) is below 
+ *	this are treated as having no texture: the shift is set to zero without solving
+ *	@param confidence if not NULL, gets the confidence
+ *	@return false if the shift was set to zero for lack of texture
+ */
+bool ofoLK_Solve(flowsums_t * sums, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
+
+/**
+ * Same as above, using the image-interpolation method
+ */
+bool ofoIIA_Solve(flowsums_t * sums, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
+
+/**
+ *  Solves for the X and Y shift from sums accumulated using the Lucas-Kanade method, 
+ *  using only 32-bit arithmetic.  The sums are first shifted right by a shared amount
+ *  so that they fit in sixteen bits, which loses some precision for very large sums 
+ *  but avoids the 64-bit multiplies and divisions of ofoLK_Solve, which are very slow
+ *  on eight-bit processors.  The shift is output in pixels with OFO_QBITS fractional 
+ *  bits (e.g. 256 = one pixel), saturating at the limits of int16_t.  Outputs zero 
+ *  shift when the system is singular (no texture).
+ *
+ *  The output is the exact solution of the shifted sums rounded toward zero, so it
+ *  is within one LSB (1/256 pixel) of that solution.  Shifting the sums right by k 
+ *  bits perturbs each by less than 2^k, which moves the solution by less than 
+ *  (1.5 + 2|v|) * 2^k / c pixels, for a shift of length |v| pixels and confidence c 
+ *  (see ofoConfidence).  Sums below 2^15 are not shifted at all; larger ones are 
+ *  shifted by the fewest bits that bring them below 2^15, which for patches with 
+ *  good texture moves the solution by well under one LSB.
+ *
+ *	@param sums accumulated gradient-product sums
+ *	@param ofx pointer to fixed-point value for X shift.
+ *	@param ofy pointer to fixed-point value for Y shift.
+ *	@param threshold as for ofoLK_Solve
+ *	@param confidence as for ofoLK_Solve, computed in 32 bits from the shifted sums
+ *	@return false if the shift was set to zero for lack of texture
+ */
+bool ofoLK_SolveFixed(flowsums_t * sums, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
+
+/**
+ * Same as above, using the image-interpolation method, whose shift and error
+ * bounds are twice those of the Lucas-Kanade method
+ */
+bool ofoIIA_SolveFixed(flowsums_t * sums, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL);
+
+/**
+ * Gets the flow sums over a rectangle from summed-area tables built by 
+ * ofoIntegral_2D, with four lookups per sum.  The rectangle is of gradient-product
+ * positions: for the square configuration, position (r,c) is the upper-left pixel
+ * of the square of pixels; for the plus configuration, the center pixel.
+ *
+ * @param sat summed-area tables
+ * @param cols number of columns of the image
+ * @param row0 first row of rectangle
+ * @param col0 first column of rectangle
+ * @param row1 row just past the end of rectangle
+ * @param col1 column just past the end of rectangle
+ * @param sums gets the sums
+ */
+void ofoIntegralSums(const FlowSums<uint32_t> * sat, uint16_t cols, 
+        uint16_t row0, uint16_t col0, uint16_t row1, uint16_t col1, flowsums_t * sums);
+
+/**
+ * Computes optical flow on a grid of square patches, which may overlap, from 
+ * summed-area tables built by ofoIntegral_2D.  The cost for each patch does not
+ * depend on the size of the patch, so patch size and overlap can be chosen freely.  
+ * The flow for each patch is the same as running the method on the patch alone, 
+ * e.g. with ofoLK_Square_2D() on an ImageView window of the image.
+ *
+ * @param sat summed-area tables built by ofoIntegral_2D with the same method
+ * @param rows number of rows of the image
+ * @param cols number of columns of the image
+ * @param method OFO_IIA_PLUS, OFO_IIA_SQUARE, OFO_LK_PLUS, or OFO_LK_SQUARE
+ * @param patchsize number of rows and columns of each patch; none are computed for zero
+ * @param step number of rows and columns between neighboring patches; zero is 
+ * taken as patchsize, for patches side by side
+ * @param scale value of one pixel of motion (for scaling output)
+ * @param ofx gets the X shift of each patch, row by row.  The grid has 
+ * (rows-patchsize)/step+1 rows and (cols-patchsize)/step+1 columns.
+ * @param ofy gets the Y shift of each patch
+ */
+void ofoLK_Grid(const FlowSums<uint32_t> * sat, uint16_t rows, uint16_t cols, uint8_t method,
+        uint16_t patchsize, uint16_t step, uint16_t scale, int16_t * ofx, int16_t * ofy);
+
+/**
+ * Computes optical flow by matching census signatures (see ofoCensus_2D) between
+ * two images.  Every displacement within the search range is tried, scoring each 
+ * by the number of signature bits that differ (the Hamming distance) over the 
+ * image, and the best is refined to a fraction of a pixel by fitting a parabola 
+ * to the scores of its neighbors.  Because the signatures depend only on the 
+ * order of pixel values, the flow is unaffected by changes in brightness or gain 
+ * between the images, and no multiplications are needed to find the match.
+ *
+ * @param curr_census signatures of current image
+ * @param last_census signatures of previous image
+ * @param rows number of rows in image
+ * @param cols number of cols in image
+ * @param range largest displacement tried, in pixels, in each direction
+ * @param scale value of one pixel of motion (for scaling output)
+ * @param ofx pointer to integer value for X shift, with the same sign as from ofoIIA_Square_2D()
+ * @param ofy pointer to integer value for Y shift
+ */
+void ofoHamming_2D(const uint8_t * curr_census, const uint8_t * last_census, uint16_t rows, uint16_t cols, 
+        uint8_t range, uint16_t scale, int16_t * ofx, int16_t * ofy);
+
+/**
+ * Motion of the whole image, as estimated from a grid of flows by ofoEgomotion().
+ * The flow at position (x,y) from the center of the grid, in units of the 
+ * spacing of the grid, is modeled as
+ *
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>u = tx + divergence*x - rotation*y</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>v = ty + divergence*y + rotation*x</tt><br>
+ */
+struct Egomotion {
+
+    int16_t tx;         // X translation, in the units of the flows
+    int16_t ty;         // Y translation
+    int32_t divergence; // expansion, in units of the flows per grid spacing, with OFO_QBITS fractional bits
+    int32_t rotation;   // counterclockwise rotation (with y down), in the same units
+};
+
+/**
+ * Estimates the translation, rotation, and divergence (expansion) that best fit 
+ * a grid of flows (e.g. from ofoLK_Grid() or FlowGrid), by least squares.  The 
+ * sums for the normal equations are accumulated in a single pass over the grid,
+ * and the equations are then solved in closed form, so the cost is a few 
+ * additions and multiplications per patch.  Patches may be left out, e.g. those 
+ * without texture.
+ *
+ * @param ofx X flow of each patch, row by row
+ * @param ofy Y flow of each patch
+ * @param valid true for each patch to use, or NULL to use all
+ * @param gridrows number of rows of patches
+ * @param gridcols number of columns of patches
+ * @param ego gets the motion
+ * @return false if the patches used do not span two dimensions
+ */
+bool ofoEgomotion(const int16_t * ofx, const int16_t * ofy, const bool * valid, uint8_t gridrows, uint8_t gridcols, 
+        Egomotion * ego);
+
+/**
+ * Returns the focus of expansion: the point of the grid where the flow modeled
+ * by ofoEgomotion() is zero, toward which the sensor is moving (or from which it 
+ * is moving away).
+ *
+ * @param ego motion from ofoEgomotion()
+ * @param foex gets X position from the center of the grid, in grid spacings, with 
+ * OFO_QBITS fractional bits
+ * @param foey gets Y position
+ * @return false if there is no divergence or rotation, so no such point
+ */
+bool ofoFocusOfExpansion(const Egomotion * ego, int32_t * foex, int32_t * foey);
+
+/**
+ * Returns the time until the sensor reaches the surface it is approaching, from
+ * the divergence of the flow: an image that grows by a fraction e each frame is
+ * 1/e frames away.
+ *
+ * @param ego motion from ofoEgomotion()
+ * @param flowscale value of one pixel of image motion in the flows; negative for 
+ * the ofo kernels, whose flow is opposite to the motion (e.g. -scale for ofoIIA_*, 
+ * -scale/2 for ofoLK_*)
+ * @param spacing spacing of the grid, in pixels
+ * @param frames gets the number of frames, with OFO_QBITS fractional bits
+ * @return false if the sensor is not approaching anything
+ */
+bool ofoTimeToContact(const Egomotion * ego, int16_t flowscale, uint16_t spacing, int32_t * frames);
+
+/**
+ * A flow configuration chosen by ofoAutotune(), which can be saved with 
+ * ofoTuningSave() so that later runs need not tune again.
+ */
+struct FlowTuning {
+
+    uint32_t usec;      // time per frame, in microseconds
+    uint16_t rows;      // image size tuned for
+    uint16_t cols;
+    uint16_t residual;  // fraction of brightness change left unexplained by the flow, with 8 fractional bits
+    uint8_t  method;    // OFO_IIA_PLUS, OFO_IIA_SQUARE, OFO_LK_PLUS, or OFO_LK_SQUARE
+    uint8_t  grid;      // number of rows and columns of patches
+    uint8_t  check;     // for recognizing a saved tuning, last so no padding precedes it
+};
+
+/**
+ * Returns the check byte of a tuning, for ofoTuningSave() and ofoTuningLoad()
+ */
+uint8_t ofoTuningCheck(const FlowTuning * tuning);
+
+/**
+ * Loads a tuning saved by ofoTuningSave(), from EEPROM on AVR Arduinos or from a
+ * file on a host computer.
+ *
+ * @param tuning gets the tuning
+ * @param rows number of rows of the images to be used
+ * @param cols number of columns of the images to be used
+ * @param where EEPROM address (Arduino) or file name (host)
+ * @return false if no tuning for images of this size was saved, or there is 
+ * nowhere to save one (Arduinos other than AVR)
+ */
+#if defined(ARDUINO)
+bool ofoTuningLoad(FlowTuning * tuning, uint16_t rows, uint16_t cols, uint16_t where=0);
+#else
+bool ofoTuningLoad(FlowTuning * tuning, uint16_t rows, uint16_t cols, const char * where="ofotune.dat");
+#endif
+
+/**
+ * Saves a tuning, to EEPROM on AVR Arduinos or to a file on a host computer.
+ *
+ * @param tuning tuning from ofoAutotune()
+ * @param where EEPROM address (Arduino) or file name (host)
+ * @return false if the tuning could not be saved
+ */
+#if defined(ARDUINO)
+bool ofoTuningSave(const FlowTuning * tuning, uint16_t where=0);
+#else
+bool ofoTuningSave(const FlowTuning * tuning, const char * where="ofotune.dat");
+#endif
+
+/**
+ * Largest window size for ofoPhaseCorr_2D()
+ */
+static const uint8_t OFO_PHASECORR_MAX = 64;
+
+/**
+ * Returns the Hann window weight of a sample, for ofoPhaseCorr_2D().
+ * @param i sample index
+ * @param n window size, a power of two from 4 to OFO_PHASECORR_MAX
+ * @return weight with 15 fractional bits
+ */
+int16_t ofo_hann(uint8_t i, uint8_t n);
+
+/**
+ * Finishes ofoPhaseCorr_2D() once the windowed samples of both images are in the
+ * work buffer.
+ */
+void ofo_phase_corr(int16_t * work, uint8_t n, uint16_t scale, int16_t * ofx, int16_t * ofy);
+
+/*********************************************************************/
+// Templated kernels.  These accept images of any integer pixel type, so that 
+// eight- and sixteen-bit images can be used in the same program; the functions 
+// above are wrappers for them using pixel_t.  The versions taking the image 
+// size as template parameters, e.g. 
+//
+//     ofoLK_Plus_2D<uint16_t, MAX_ROWS, MAX_COLS>(curr_img, last_img, scale, &ofx, &ofy)
+//
+// compile to loops with constant bounds and strides, which the compiler can
+// unroll completely when optimizing for speed.
+
+// Differences of pixels as differential type D.  Sixteen-bit differentials are 
+// taken modulo 2^16, as the subtraction of two uint16_t pixels gives on AVR; wider 
+// ones convert the pixels first, so that they are exact on every processor.
+template <typename D>
+struct ofo_diff {
+
+    template <typename P>
+    static D one(P a, P b) { return (D)a - (D)b; }
+
+    template <typename P>
+    static D two(P a, P b, P c, P d) { return ((D)a - (D)b) + ((D)c - (D)d); }
+};
+
+template <>
+struct ofo_diff<int16_t> {
+
+    template <typename P>
+    static int16_t one(P a, P b) { return (int16_t)(a - b); }
+
+    template <typename P>
+    static int16_t two(P a, P b, P c, P d) { return (int16_t)((a - b) + (c - d)); }
+};
+
+// Accumulates sums for plus configuration; ROWS, COLS of zero mean use rows, cols
+template <typename P, uint16_t ROWS, uint16_t COLS, typename D, typename A>
+inline void ofo_sums_plus(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, FlowSums<A> * sums)
+{
+    const uint16_t R = ROWS ? ROWS : rows;
+    const uint16_t C = COLS ? COLS : cols;
+    const uint16_t S = curr_stride;
+    const uint16_t Z = last_stride;
+
+    A A11=0, A12=0, A22=0, b1=0, b2=0;
+
+    // set up pointers
+    const P *f0 = curr_img + S + 1;     // center image
+    const P *f1 = curr_img + S + 2;     // right-shifted image
+    const P *f2 = curr_img + S;         // left-shifted image	
+    const P *f3 = curr_img + 2*S + 1;   // down-shifted image	
+    const P *f4 = curr_img + 1;         // up-shifted image
+    const P *fz = last_img + Z + 1;     // time-shifted image
+
+    for (uint16_t r=1; r<R-1; ++r) { 
+
+        for (uint16_t c=1; c<C-1; ++c) { 
+
+            // compute differentials, then increment pointers (post-increment)
+            D F2F1 = ofo_diff<D>::one(*(f2++), *(f1++));	//horizontal differential
+            D F4F3 = ofo_diff<D>::one(*(f4++), *(f3++));	//vertical differential
+            D FCF0 = ofo_diff<D>::one(*(fz++), *(f0++));	//time differential
+
+            // update summations
+            A11 += (A)F2F1 * F2F1;
+            A12 += (A)F4F3 * F2F1;
+            A22 += (A)F4F3 * F4F3;
+            b1  += (A)FCF0 * F2F1;
+            b2  += (A)FCF0 * F4F3;
+        }
+
+        f0+=S-C+2;	//move to next row of image
+        fz+=Z-C+2;
+        f1+=S-C+2;
+        f2+=S-C+2;
+        f3+=S-C+2;
+        f4+=S-C+2;
+    }
+
+    sums->A11 = A11;
+    sums->A12 = A12;
+    sums->A22 = A22;
+    sums->b1  = b1;
+    sums->b2  = b2;
+}
+
+// Accumulates sums for square configuration; ROWS, COLS of zero mean use rows, cols
+template <typename P, uint16_t ROWS, uint16_t COLS, typename D, typename A>
+inline void ofo_sums_square(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, FlowSums<A> * sums)
+{
+    const uint16_t R = ROWS ? ROWS : rows;
+    const uint16_t C = COLS ? COLS : cols;
+    const uint16_t S = curr_stride;
+    const uint16_t Z = last_stride;
+
+    A A11=0, A12=0, A22=0, b1=0, b2=0;
+
+    // set up pointers
+    const P *f0 = curr_img;             // top left 
+    const P *f1 = curr_img + 1;         // top right
+    const P *f2 = curr_img + S;         // bottom left
+    const P *f3 = curr_img + S + 1;     // bottom right
+    const P *fz = last_img;             // top left time-shifted
+
+    for (uint16_t r=0; r<R-1; ++r) { 
+
+        for (uint16_t c=0; c<C-1; ++c) { 
+
+            // compute differentials      
+            D F2F1 = ofo_diff<D>::two(*(f0), *(f1), *(f2), *(f3));
+            D F4F3 = ofo_diff<D>::two(*(f0), *(f2), *(f1), *(f3));
+            D FCF0 = ofo_diff<D>::one(*(fz), *(f0));
+
+            //increment pointers
+            f0++;
+            fz++;
+            f1++;
+            f2++;
+            f3++;
+
+            // update summations
+            A11 += (A)F2F1 * F2F1;
+            A12 += (A)F4F3 * F2F1;
+            A22 += (A)F4F3 * F4F3;
+            b1  += (A)FCF0 * F2F1;
+            b2  += (A)FCF0 * F4F3;
+        }
+
+        //go to next row
+        f0+=S-C+1;
+        fz+=Z-C+1;
+        f1+=S-C+1;
+        f2+=S-C+1;
+        f3+=S-C+1;
+    }
+
+    sums->A11 = A11;
+    sums->A12 = A12;
+    sums->A22 = A22;
+    sums->b1  = b1;
+    sums->b2  = b2;
+}
+
+// Copies sums into the 32-bit sums used by the solvers.  Sixty-four-bit sums are
+// all shifted right by the same amount, which cancels out in the solution.
+inline void ofo_narrow(const FlowSums<int16_t> & wide, flowsums_t * sums)
+{
+    sums->A11 = wide.A11;
+    sums->A12 = wide.A12;
+    sums->A22 = wide.A22;
+    sums->b1  = wide.b1;
+    sums->b2  = wide.b2;
+}
+
+inline void ofo_narrow(const FlowSums<int32_t> & wide, flowsums_t * sums)
+{
+    *sums = wide;
+}
+
+inline void ofo_narrow(const FlowSums<int64_t> & wide, flowsums_t * sums)
+{
+    int64_t all[5] = {wide.A11, wide.A12, wide.A22, wide.b1, wide.b2};
+
+    uint64_t biggest = 0;
+    for (uint8_t i=0; i<5; ++i) {
+        uint64_t mag = all[i] < 0 ? -(uint64_t)all[i] : (uint64_t)all[i];
+        if (mag > biggest)
+            biggest = mag;
+    }
+
+    uint8_t shift = 0;
+    while (biggest > 0x7FFFFFFF) {
+        biggest >>= 1;
+        shift++;
+    }
+
+    sums->A11 = (int32_t)(wide.A11 >> shift);
+    sums->A12 = (int32_t)(wide.A12 >> shift);
+    sums->A22 = (int32_t)(wide.A22 >> shift);
+    sums->b1  = (int32_t)(wide.b1  >> shift);
+    sums->b2  = (int32_t)(wide.b2  >> shift);
+}
+
+// Accumulates sums for an image of compile-time size with the narrowest safe types
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS>
+inline void ofo_sums_plus_sized(const P * curr_img, const P * last_img, flowsums_t * sums)
+{
+    static_assert(ROWS >= 3 && COLS >= 3, "plus configuration needs at least 3x3 pixels");
+    static_assert(BITS <= 8*sizeof(P), "pixel type is too narrow for BITS");
+
+    typedef ofoAccumulator<BITS, (uint32_t)(ROWS-2)*(COLS-2), false> acc;
+
+    FlowSums<typename acc::type> wide;
+    ofo_sums_plus<P, ROWS, COLS, typename acc::diff_type, typename acc::type>(curr_img, last_img, ROWS, COLS, COLS, COLS, &wide);
+    ofo_narrow(wide, sums);
+}
+
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS>
+inline void ofo_sums_square_sized(const P * curr_img, const P * last_img, flowsums_t * sums)
+{
+    static_assert(ROWS >= 2 && COLS >= 2, "square configuration needs at least 2x2 pixels");
+    static_assert(BITS <= 8*sizeof(P), "pixel type is too narrow for BITS");
+
+    typedef ofoAccumulator<BITS, (uint32_t)(ROWS-1)*(COLS-1), true> acc;
+
+    FlowSums<typename acc::type> wide;
+    ofo_sums_square<P, ROWS, COLS, typename acc::diff_type, typename acc::type>(curr_img, last_img, ROWS, COLS, COLS, COLS, &wide);
+    ofo_narrow(wide, sums);
+}
+
+// Accumulates the one-dimensional image-interpolation sums, with differentials of
+// type D and sums of type A
+template <typename P, typename D=int16_t, typename A=int32_t>
+inline void ofo_sums_1d(const P * curr_img, const P * last_img, uint16_t numpix, A * top, A * bottom)
+{
+    A t = 0;
+    A b = 0;
+
+    for (uint16_t i=1; i+1<numpix; ++i) {
+        D deltat = ofo_diff<D>::one(last_img[i], curr_img[i]);      // temporal gradient
+        D deltax = ofo_diff<D>::one(curr_img[i+1], curr_img[i-1]);  // spatial gradient
+        t += (A)deltat * deltax;
+        b += (A)deltax * deltax;
+    }
+
+    *top = t;
+    *bottom = b;
+}
+
+// Accumulates 1D sums for numstrips strips, where pixel i of strip k is at 
+// k*stripstride + i*pixstride.  Each pixel of the current image is read once, 
+// keeping its neighbors from the previous step.
+template <typename P, typename D=int16_t, typename A=int32_t>
+inline void ofo_sums_1d_batch(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, A * top, A * bottom)
+{
+    for (uint16_t k=0; k<numstrips; ++k) {
+
+        if (numpix < 3) {
+            top[k] = 0;
+            bottom[k] = 0;
+            continue;
+        }
+
+        const P * f = curr_img + (uint32_t)k*stripstride;
+        const P * z = last_img + (uint32_t)k*stripstride + pixstride;
+
+        A t = 0;
+        A b = 0;
+
+        P left = f[0];
+        P mid  = f[pixstride];
+
+        f += 2*pixstride;
+
+        for (uint16_t i=1; i+1<numpix; ++i) {
+            P right = *f;
+            D deltax = ofo_diff<D>::one(right, left);   // spatial gradient
+            D deltat = ofo_diff<D>::one(*z, mid);       // temporal gradient
+            t += (A)deltat * deltax;
+            b += (A)deltax * deltax;
+            left = mid;
+            mid = right;
+            f += pixstride;
+            z += pixstride;
+        }
+
+        top[k] = t;
+        bottom[k] = b;
+    }
+}
+
+// Sums for images whose size is given at run time.  On x86 host computers, 
+// OpticalFlowSIMD.cpp overloads these for eight- and sixteen-bit pixels with 
+// SSE2 and AVX2 versions, chosen according to the processor at run time, which
+// give exactly the same sums.
+template <typename P>
+inline void ofo_sums_plus_rt(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    ofo_sums_plus<P,0,0,int16_t,int32_t>(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+}
+
+template <typename P>
+inline void ofo_sums_square_rt(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    ofo_sums_square<P,0,0,int16_t,int32_t>(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+}
+
+template <typename P>
+inline void ofo_sums_1d_rt(const P * curr_img, const P * last_img, uint16_t numpix, int32_t * top, int32_t * bottom)
+{
+    ofo_sums_1d(curr_img, last_img, numpix, top, bottom);
+}
+
+template <typename P>
+inline void ofo_sums_1d_batch_rt(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, int32_t * top, int32_t * bottom)
+{
+    ofo_sums_1d_batch(curr_img, last_img, numpix, pixstride, numstrips, stripstride, top, bottom);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OFO_SIMD
+void ofo_sums_plus_rt(const uint8_t * curr_img, const uint8_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums);
+void ofo_sums_plus_rt(const uint16_t * curr_img, const uint16_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums);
+void ofo_sums_square_rt(const uint8_t * curr_img, const uint8_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums);
+void ofo_sums_square_rt(const uint16_t * curr_img, const uint16_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums);
+void ofo_sums_1d_rt(const pixel_t * curr_img, const pixel_t * last_img, uint16_t numpix, int32_t * top, int32_t * bottom);
+void ofo_sums_1d_batch_rt(const uint8_t * curr_img, const uint8_t * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, int32_t * top, int32_t * bottom);
+void ofo_sums_1d_batch_rt(const uint16_t * curr_img, const uint16_t * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, int32_t * top, int32_t * bottom);
+#endif
+
+// Sums for images whose size is given at run time, for pixels spanning BITS bits,
+// that cannot overflow.  When the 32-bit sums of the kernels above could overflow
+// over the whole image, the image is summed in bands of rows small enough for 
+// them, and the bands are added in 64 bits; when even a single row could overflow,
+// or the kernels' sixteen-bit differentials are too narrow, each product is added
+// in 64 bits.
+template <uint8_t BITS, bool SQUARE, typename P>
+void ofo_sums_wide(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    typedef ofoAccumulator<BITS, 1, SQUARE> acc;
+
+    // number of products that fit in a 32-bit sum
+    static const uint32_t PRODUCTS = acc::DMAX > 0x7FFF ? 0 : 0x7FFFFFFF / (uint32_t)(acc::DMAX * acc::DMAX);
+
+    // rows and columns that are not the center of a differential
+    const uint8_t border = SQUARE ? 1 : 2;
+
+    if (rows <= border || cols <= border) {
+        memset(sums, 0, sizeof(flowsums_t));
+        return;
+    }
+
+    const uint16_t centers = rows - border;
+    const uint32_t band = PRODUCTS / (uint32_t)(cols - border);
+
+    if (band >= centers) {
+        if (SQUARE)
+            ofo_sums_square_rt(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+        else
+            ofo_sums_plus_rt(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+        return;
+    }
+
+    FlowSums<int64_t> wide;
+
+    if (band == 0) {
+        if (SQUARE)
+            ofo_sums_square<P,0,0,typename acc::diff_type,int64_t>(curr_img, last_img, rows, cols, 
+                    curr_stride, last_stride, &wide);
+        else
+            ofo_sums_plus<P,0,0,typename acc::diff_type,int64_t>(curr_img, last_img, rows, cols, 
+                    curr_stride, last_stride, &wide);
+    }
+
+    else {
+
+        memset(&wide, 0, sizeof(wide));
+
+        for (uint16_t r=0; r<centers; r+=band) {
+
+            const uint16_t n = (uint32_t)(centers - r) < band ? centers - r : band;
+
+            flowsums_t part;
+            if (SQUARE)
+                ofo_sums_square_rt(curr_img + (uint32_t)r*curr_stride, last_img + (uint32_t)r*last_stride, 
+                        n+border, cols, curr_stride, last_stride, &part);
+            else
+                ofo_sums_plus_rt(curr_img + (uint32_t)r*curr_stride, last_img + (uint32_t)r*last_stride, 
+                        n+border, cols, curr_stride, last_stride, &part);
+
+            wide.A11 += part.A11;
+            wide.A12 += part.A12;
+            wide.A22 += part.A22;
+            wide.b1  += part.b1;
+            wide.b2  += part.b2;
+        }
+    }
+
+    ofo_narrow(wide, sums);
+}
+
+// Copies a pair of one-dimensional sums into 32 bits, shifting both right by the 
+// same amount, which cancels out in the solution
+inline void ofo_narrow_1d(int64_t t, int64_t b, int32_t * top, int32_t * bottom)
+{
+    uint64_t biggest = t < 0 ? -(uint64_t)t : (uint64_t)t;
+    if ((uint64_t)b > biggest)
+        biggest = (uint64_t)b;
+
+    uint8_t shift = 0;
+    while (biggest > 0x7FFFFFFF) {
+        biggest >>= 1;
+        shift++;
+    }
+
+    *top = (int32_t)(t >> shift);
+    *bottom = (int32_t)(b >> shift);
+}
+
+// One-dimensional sums for strips of pixels spanning BITS bits, that cannot 
+// overflow, as ofo_sums_wide() does for the two-dimensional sums: strips short 
+// enough for the 32-bit sums of the kernels above go to them, longer ones are 
+// summed in segments that are added in 64 bits, and each product is added in 64 
+// bits when even a single one could overflow or the kernels' sixteen-bit 
+// differentials are too narrow, as for row-sum projections spanning all 16 bits.
+template <uint8_t BITS, typename P>
+void ofo_sums_1d_wide(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, int32_t * top, int32_t * bottom)
+{
+    static_assert(BITS <= 8*sizeof(P), "pixel type is too narrow for BITS");
+
+    typedef ofoAccumulator<BITS, 1, false> acc;
+
+    // number of products that fit in a 32-bit sum
+    static const uint32_t PRODUCTS = acc::DMAX > 0x7FFF ? 0 : 0x7FFFFFFF / (uint32_t)(acc::DMAX * acc::DMAX);
+
+    // pixels that are the center of a differential
+    const uint16_t centers = numpix < 3 ? 0 : numpix - 2;
+
+    if (centers <= PRODUCTS) {
+        if (pixstride == 1)
+            for (uint16_t k=0; k<numstrips; ++k)
+                ofo_sums_1d_rt(curr_img + (uint32_t)k*stripstride, last_img + (uint32_t)k*stripstride, 
+                        numpix, &top[k], &bottom[k]);
+        else
+            ofo_sums_1d_batch_rt(curr_img, last_img, numpix, pixstride, numstrips, stripstride, top, bottom);
+        return;
+    }
+
+    for (uint16_t k=0; k<numstrips; ++k) {
+
+        const P * curr = curr_img + (uint32_t)k*stripstride;
+        const P * last = last_img + (uint32_t)k*stripstride;
+
+        int64_t t = 0;
+        int64_t b = 0;
+
+        if (PRODUCTS == 0)
+            ofo_sums_1d_batch<P, typename acc::diff_type, int64_t>(curr, last, numpix, pixstride, 1, 0, &t, &b);
+
+        // segments overlap by the two pixels on either side of their centers
+        else
+            for (uint32_t i=0; i<centers; i+=PRODUCTS) {
+                const uint16_t n = (uint32_t)(centers - i) < PRODUCTS ? centers - i : PRODUCTS;
+                int32_t pt, pb;
+                ofo_sums_1d_batch_rt(curr + (uint32_t)i*pixstride, last + (uint32_t)i*pixstride, 
+                        n+2, pixstride, 1, 0, &pt, &pb);
+                t += pt;
+                b += pb;
+            }
+
+        ofo_narrow_1d(t, b, &top[k], &bottom[k]);
+    }
+}
+
+// None of the versions can overflow.  The versions taking the size at compile 
+// time choose the types with ofoAccumulator; the versions taking it at run time 
+// use 32-bit sums where they are safe, and otherwise add bands of the image or 
+// single products in 64 bits.  Pass BITS to describe pixels that span fewer bits
+// than their type, e.g. ofoLK_Plus_2D<uint16_t, 48, 48, 11>() or 
+// ofoLK_Plus_2D<uint16_t, 11>(curr_img, last_img, rows, cols, ...), which keeps 
+// more of the work in 32 bits: sixteen-bit pixels that span all 16 bits need 
+// 64-bit sums for every product.
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+void ofoSums_Plus_2D(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, flowsums_t * sums)
+{
+    ofo_sums_wide<BITS,false>(curr_img, last_img, rows, cols, cols, cols, sums);
+}
+
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS=8*sizeof(P)>
+void ofoSums_Plus_2D(const P * curr_img, const P * last_img, flowsums_t * sums)
+{
+    ofo_sums_plus_sized<P,ROWS,COLS,BITS>(curr_img, last_img, sums);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+void ofoSums_Square_2D(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, flowsums_t * sums)
+{
+    ofo_sums_wide<BITS,true>(curr_img, last_img, rows, cols, cols, cols, sums);
+}
+
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS=8*sizeof(P)>
+void ofoSums_Square_2D(const P * curr_img, const P * last_img, flowsums_t * sums)
+{
+    ofo_sums_square_sized<P,ROWS,COLS,BITS>(curr_img, last_img, sums);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoIIA_Plus_2D(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_wide<BITS,false>(curr_img, last_img, rows, cols, cols, cols, &sums);
+    return ofoIIA_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS=8*sizeof(P)>
+bool ofoIIA_Plus_2D(const P * curr_img, const P * last_img, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_plus_sized<P,ROWS,COLS,BITS>(curr_img, last_img, &sums);
+    return ofoIIA_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoIIA_Square_2D(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_wide<BITS,true>(curr_img, last_img, rows, cols, cols, cols, &sums);
+    return ofoIIA_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS=8*sizeof(P)>
+bool ofoIIA_Square_2D(const P * curr_img, const P * last_img, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_square_sized<P,ROWS,COLS,BITS>(curr_img, last_img, &sums);
+    return ofoIIA_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoLK_Plus_2D(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_wide<BITS,false>(curr_img, last_img, rows, cols, cols, cols, &sums);
+    return ofoLK_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS=8*sizeof(P)>
+bool ofoLK_Plus_2D(const P * curr_img, const P * last_img, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_plus_sized<P,ROWS,COLS,BITS>(curr_img, last_img, &sums);
+    return ofoLK_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoLK_Square_2D(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_wide<BITS,true>(curr_img, last_img, rows, cols, cols, cols, &sums);
+    return ofoLK_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint16_t ROWS, uint16_t COLS, uint8_t BITS=8*sizeof(P)>
+bool ofoLK_Square_2D(const P * curr_img, const P * last_img, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofo_sums_square_sized<P,ROWS,COLS,BITS>(curr_img, last_img, &sums);
+    return ofoLK_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+// Versions taking ImageViews, for computing flow on a rectangle of a larger image
+// (e.g. one patch of a camera frame) in place.  The two views must have the same 
+// number of rows and columns, but may have different strides.
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+void ofoSums_Plus_2D(ImageView<P> curr, ImageView<P> last, flowsums_t * sums)
+{
+    ofo_sums_wide<BITS,false>(curr.pixels(), last.pixels(), curr.rows(), curr.cols(), curr.stride(), last.stride(), sums);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+void ofoSums_Square_2D(ImageView<P> curr, ImageView<P> last, flowsums_t * sums)
+{
+    ofo_sums_wide<BITS,true>(curr.pixels(), last.pixels(), curr.rows(), curr.cols(), curr.stride(), last.stride(), sums);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoIIA_Plus_2D(ImageView<P> curr, ImageView<P> last, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofoSums_Plus_2D<P,BITS>(curr, last, &sums);
+    return ofoIIA_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoIIA_Square_2D(ImageView<P> curr, ImageView<P> last, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofoSums_Square_2D<P,BITS>(curr, last, &sums);
+    return ofoIIA_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoLK_Plus_2D(ImageView<P> curr, ImageView<P> last, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofoSums_Plus_2D<P,BITS>(curr, last, &sums);
+    return ofoLK_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoLK_Square_2D(ImageView<P> curr, ImageView<P> last, uint16_t scale, int16_t * ofx, int16_t * ofy, 
+        uint32_t threshold=0, uint32_t * confidence=NULL)
+{
+    flowsums_t sums;
+    ofoSums_Square_2D<P,BITS>(curr, last, &sums);
+    return ofoLK_Solve(&sums, scale, ofx, ofy, threshold, confidence);
+}
+
+/**
+ * Builds summed-area tables of the five gradient-product images in one pass over
+ * the current and previous images, for ofoIntegralSums() and ofoLK_Grid().  
+ * Entry (r,c) of the tables holds the sums of the products at all positions above
+ * and to the left of pixel (r,c), so the tables need (rows+1)*(cols+1) entries 
+ * (about 640 kilobytes for a 320x240 image).  The sums wrap around modulo 2^32, 
+ * which leaves the sums over any patch exact as long as they fit in 32 bits.
+ *
+ * @param curr current image
+ * @param last previous image, with the same number of rows and columns
+ * @param method OFO_IIA_PLUS, OFO_IIA_SQUARE, OFO_LK_PLUS, or OFO_LK_SQUARE
+ * @param sat gets the tables
+ */
+template <typename P>
+void ofoIntegral_2D(ImageView<P> curr, ImageView<P> last, uint8_t method, FlowSums<uint32_t> * sat)
+{
+    const uint16_t R = curr.rows();
+    const uint16_t C = curr.cols();
+    const uint16_t S = curr.stride();
+
+    const bool square = method == OFO_IIA_SQUARE || method == OFO_LK_SQUARE;
+
+    // products are defined at positions whose neighbors are all in the image:
+    // rows and columns 0 to size-2 for square, 1 to size-2 for plus
+    const uint16_t first = square ? 0 : 1;
+
+    // top row and left column of the tables are zero
+    for (uint16_t c=0; c<=C; ++c) {
+        sat[c].A11 = sat[c].A12 = sat[c].A22 = sat[c].b1 = sat[c].b2 = 0;
+    }
+
+    for (uint16_t r=0; r<R; ++r) {
+
+        const P * f = curr.row(r);
+        const P * z = last.row(r);
+
+        FlowSums<uint32_t> * above = sat + (uint32_t)r*(C+1);
+        FlowSums<uint32_t> * here  = above + C + 1;
+
+        here->A11 = here->A12 = here->A22 = here->b1 = here->b2 = 0;
+
+        uint32_t A11=0, A12=0, A22=0, b1=0, b2=0;
+
+        bool rowok = r >= first && r < R-1;
+
+        for (uint16_t c=0; c<C; ++c) {
+
+            if (rowok && c >= first && c < C-1) {
+
+                // differentials as in ofo_sums_square() and ofo_sums_plus()
+                int16_t F2F1, F4F3;
+                if (square) {
+                    F2F1 = ((f[c] - f[c+1]) + (f[c+S] - f[c+S+1]));
+                    F4F3 = ((f[c] - f[c+S]) + (f[c+1] - f[c+S+1]));
+                }
+                else {
+                    F2F1 = (f[c-1] - f[c+1]);
+                    F4F3 = (f[c-S] - f[c+S]);
+                }
+                int16_t FCF0 = (z[c] - f[c]);
+
+                A11 += (uint32_t)((int32_t)F2F1 * F2F1);
+                A12 += (uint32_t)((int32_t)F4F3 * F2F1);
+                A22 += (uint32_t)((int32_t)F4F3 * F4F3);
+                b1  += (uint32_t)((int32_t)FCF0 * F2F1);
+                b2  += (uint32_t)((int32_t)FCF0 * F4F3);
+            }
+
+            // table entry is entry above plus sums along this row so far
+            here[c+1].A11 = above[c+1].A11 + A11;
+            here[c+1].A12 = above[c+1].A12 + A12;
+            here[c+1].A22 = above[c+1].A22 + A22;
+            here[c+1].b1  = above[c+1].b1  + b1;
+            here[c+1].b2  = above[c+1].b2  + b2;
+        }
+    }
+}
+
+/**
+ * A ring of recent images, as in FrameRing, together with the spatial gradients
+ * (horizontal and vertical differentials) of each image.  The gradients of an image 
+ * are computed the first time they are needed and kept with the image until its 
+ * buffer is reused by rotate(), so every flow computation, patch, and baseline that
+ * uses the image shares one computation.  For example,
+ *
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>GradientRing<uint8_t, 3, 48, 64> ring;</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>acquire(ring.rotate());</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>ring.sums(0, 0, 48, 64, 1, &sums);  // whole image against previous</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>ring.sums(0, 0, 48, 64, 2, &sums);  // against the one before</tt><br>
+ *
+ * gives the same sums as ofoSums_Square_2D() on each pair of images, but computes 
+ * the gradients of the current image once.  Images should not be changed after their 
+ * gradients have been used.
+ *
+ * @param P pixel type
+ * @param N number of images kept
+ * @param ROWS number of rows in each image
+ * @param COLS number of columns in each image
+ * @param SQUARE true for gradients of the square pixel configuration, false for plus
+ * @param G gradient type: int16_t gives exactly the differentials of the kernels; 
+ * int8_t halves the memory of the gradients by dropping the low bits of 
+ * differentials that would not fit, so the sums are then approximate
+ * @param BITS number of bits spanned by pixel values, for choosing the shift for int8_t
+ * and the type of the sums; differentials must fit in sixteen bits, so this is at 
+ * most 14 for the square configuration and 15 for plus
+ */
+template <typename P, uint8_t N, uint16_t ROWS, uint16_t COLS, bool SQUARE=true, typename G=int16_t, uint8_t BITS=8*sizeof(P)>
+class GradientRing {
+
+    static_assert((uint32_t)ROWS*COLS <= 0xFFFF, "images must have at most 65535 pixels");
+    static_assert(ofoAccumulator<BITS, 1, SQUARE>::DMAX <= 0x7FFF, "differentials must fit in int16_t");
+
+    private:
+
+        static const uint16_t NUMPIX = (uint16_t)(ROWS*COLS);
+
+        // right shift that makes differentials fit in G
+        static const uint8_t SHIFT = 
+            sizeof(G) >= 2 ? 0 : (BITS + (SQUARE ? 2 : 1) > 8 ? BITS + (SQUARE ? 2 : 1) - 8 : 0);
+
+        FrameRing<P, N, NUMPIX> _frames;
+
+        G _ix[N][NUMPIX];
+        G _iy[N][NUMPIX];
+
+        uint8_t _current;
+        bool    _valid[N];
+
+        // products are defined at positions whose neighbors are all in the image
+        static const uint16_t FIRST = SQUARE ? 0 : 1;
+
+        uint8_t slot(uint8_t k) 
+        {
+            return (_current + N - k) % N;
+        }
+
+        void compute(uint8_t s, const P * f)
+        {
+            G * ix = _ix[s];
+            G * iy = _iy[s];
+
+            for (uint16_t r=FIRST; r<ROWS-1; ++r) {
+                for (uint16_t c=FIRST; c<COLS-1; ++c) {
+                    uint16_t i = r*COLS + c;
+                    int16_t dx, dy;
+                    if (SQUARE) {
+                        dx = ((f[i] - f[i+1]) + (f[i+COLS] - f[i+COLS+1]));
+                        dy = ((f[i] - f[i+COLS]) + (f[i+1] - f[i+COLS+1]));
+                    }
+                    else {
+                        dx = (f[i-1] - f[i+1]);
+                        dy = (f[i-COLS] - f[i+COLS]);
+                    }
+                    ix[i] = (G)(dx >> SHIFT);
+                    iy[i] = (G)(dy >> SHIFT);
+                }
+            }
+
+            _valid[s] = true;
+        }
+
+        // Accumulates sums over a patch; the gradient is that of image 0, or the sum 
+        // of those of images 0 and k when symmetric.  The sums are wide enough for the
+        // whole image, doubling the differentials when symmetric.
+        template <bool SYMMETRIC>
+        void accumulate(uint16_t row, uint16_t col, uint16_t numrows, uint16_t numcols, 
+                uint8_t k, flowsums_t * sums)
+        {
+            typedef ofoAccumulator<BITS + (SYMMETRIC ? 1 : 0), NUMPIX, SQUARE> acc;
+            typedef typename acc::diff_type D;
+            typedef typename acc::type A;
+
+            const P * curr = _frames.current();
+            const P * last = _frames.previous(k);
+            const G * ix0 = gradientX(0);
+            const G * iy0 = gradientY(0);
+            const G * ixk = SYMMETRIC ? gradientX(k) : NULL;
+            const G * iyk = SYMMETRIC ? gradientY(k) : NULL;
+
+            FlowSums<A> wide = {0, 0, 0, 0, 0};
+
+            for (uint16_t r=row+FIRST; r<row+numrows-1; ++r) {
+                for (uint16_t c=col+FIRST; c<col+numcols-1; ++c) {
+                    uint16_t i = r*COLS + c;
+                    D dx = SYMMETRIC ? (D)ix0[i] + ixk[i] : ix0[i];
+                    D dy = SYMMETRIC ? (D)iy0[i] + iyk[i] : iy0[i];
+                    D dt = ofo_diff<int16_t>::one(last[i], curr[i]);
+                    wide.A11 += (A)dx * dx;
+                    wide.A12 += (A)dy * dx;
+                    wide.A22 += (A)dy * dy;
+                    wide.b1  += (A)dt * dx;
+                    wide.b2  += (A)dt * dy;
+                }
+            }
+
+            // undo the shift of int8_t gradients, so the sums approximate the exact ones
+            wide.A11 *= (A)1 << (2*SHIFT);
+            wide.A12 *= (A)1 << (2*SHIFT);
+            wide.A22 *= (A)1 << (2*SHIFT);
+            wide.b1  *= (A)1 << SHIFT;
+            wide.b2  *= (A)1 << SHIFT;
+
+            ofo_narrow(wide, sums);
+        }
+
+    public:
+
+        GradientRing(void) : _current(0) 
+        {
+            for (uint8_t k=0; k<N; ++k)
+                _valid[k] = false;
+        }
+
+        /**
+          * Retires the oldest image and its gradients, making its buffer current for 
+          * the next image to be acquired.
+          * @return buffer for the next image
+          */
+        P * rotate(void) 
+        {
+            _current = (_current + 1) % N;
+            _valid[_current] = false;
+            return _frames.rotate();
+        }
+
+        /**
+          * Returns an image.
+          * @param k how many images back (0 for the newest, up to N-1)
+          * @return image pixels
+          */
+        P * image(uint8_t k=0) 
+        {
+            return k ? _frames.previous(k) : _frames.current();
+        }
+
+        /**
+          * Returns the horizontal gradient of an image, computing it if needed.  
+          * Only positions whose neighbors are all in the image are valid.
+          * @param k how many images back (0 for the newest, up to N-1)
+          * @return gradient, one value per pixel, right-shifted for int8_t
+          */
+        const G * gradientX(uint8_t k=0) 
+        {
+            uint8_t s = slot(k);
+            if (!_valid[s])
+                compute(s, image(k));
+            return _ix[s];
+        }
+
+        /**
+          * Returns the vertical gradient of an image; see gradientX().
+          */
+        const G * gradientY(uint8_t k=0) 
+        {
+            uint8_t s = slot(k);
+            if (!_valid[s])
+                compute(s, image(k));
+            return _iy[s];
+        }
+
+        /**
+          * Gets the flow sums for a patch of the newest image against an earlier one,
+          * using the cached gradients of the newest image.  With int16_t gradients these
+          * are the sums ofoSums_Plus_2D() or ofoSums_Square_2D() would give for the patch.
+          * @param row row of upper-left pixel of patch
+          * @param col column of upper-left pixel of patch
+          * @param numrows number of rows of patch
+          * @param numcols number of columns of patch
+          * @param k how many images back to compare with (1 to N-1)
+          * @param sums gets the sums
+          */
+        void sums(uint16_t row, uint16_t col, uint16_t numrows, uint16_t numcols, uint8_t k, flowsums_t * sums)
+        {
+            accumulate<false>(row, col, numrows, numcols, k, sums);
+        }
+
+        /**
+          * Same as above, using the sum of the gradients of both images, which makes
+          * the estimate symmetric in time.  Since the gradient is doubled, pass twice the
+          * usual scale to ofoLK_Solve() or ofoIIA_Solve().  The gradients of each image 
+          * are still computed only once.
+          */
+        void symmetricSums(uint16_t row, uint16_t col, uint16_t numrows, uint16_t numcols, uint8_t k, flowsums_t * sums)
+        {
+            accumulate<true>(row, col, numrows, numcols, k, sums);
+        }
+};
+
+/**
+ * Maximum number of levels for ofoLK_Pyramid()
+ */
+static const uint8_t OFO_PYRAMID_LEVELS = 8;
+
+/**
+ * Smallest number of rows or columns of a level of ofoLK_Pyramid(): enough to 
+ * leave 6x6 pixels once the one-pixel border of the gradients is removed
+ */
+static const uint8_t OFO_PYRAMID_MIN = 8;
+
+/**
+ * Returns the number of pixels of work buffer needed by ofoLK_Pyramid(), for 
+ * declaring the buffer statically; e.g. 
+ * <tt>static uint16_t work[ofoPyramidWorkSize(MAX_ROWS, MAX_COLS, 3)];</tt>
+ *
+ * @param rows number of rows of the images
+ * @param cols number of columns of the images
+ * @param levels number of pyramid levels, including the full-size images
+ * @return number of pixels
+ */
+constexpr uint32_t ofoPyramidWorkSize(uint16_t rows, uint16_t cols, uint8_t levels)
+{
+    return levels <= 1 ? 
+        (uint32_t)rows*cols : 
+        ofoPyramidWorkSize(rows, cols, levels-1) + 2 * (uint32_t)(rows>>(levels-1)) * (cols>>(levels-1));
+}
+
+/**
+ * Computes optical flow using the Lucas-Kanade method on a pyramid of images, 
+ * for motion of several pixels per frame.  Each image is repeatedly halved in size
+ * (by averaging 2x2 squares of pixels), and the flow found on the smallest images
+ * is doubled and refined on each larger pair in turn.  At each level the previous
+ * image is shifted by the flow found so far, with bilinear interpolation, and the
+ * remaining flow is solved in fixed point with the plus pixel configuration, whose
+ * gradients and temporal differences are centered on the same pixel, leaving out 
+ * the borders that the shift has moved off the image.  A refinement whose system is
+ * singular or below the texture threshold ends the refinements at that level; one 
+ * of more than a pixel, beyond the reach of the linear approximation, is cut to a 
+ * pixel in the same direction.  All memory is in the work buffer.
+ *
+ * @param curr_img pixels of current image
+ * @param last_img pixels of previous image
+ * @param rows number of rows in image
+ * @param cols number of cols in image
+ * @param levels number of pyramid levels, including the full-size images, up to 
+ * OFO_PYRAMID_LEVELS; levels whose images would be smaller than OFO_PYRAMID_MIN pixels
+ * on a side are not used
+ * @param iterations maximum number of refinements at each level
+ * @param work buffer of ofoPyramidWorkSize(rows, cols, levels) pixels
+ * @param scale value of one pixel of motion (for scaling output)
+ * @param ofx pointer to integer value for X shift, in the same units as ofoLK_Plus_2D()
+ * @param ofy pointer to integer value for Y shift
+ * @param threshold minimum confidence (see ofoConfidence) of the sums of a refinement, 
+ * at any level; zero accepts every nonsingular system
+ */
+template <typename P, uint8_t BITS=8*sizeof(P)>
+void ofoLK_Pyramid(P * curr_img, P * last_img, uint16_t rows, uint16_t cols, uint8_t levels, uint8_t iterations,
+        P * work, uint16_t scale, int16_t * ofx, int16_t * ofy, uint32_t threshold=0)
+{
+    static_assert(OFO_QBITS <= 8, "imgWarpBilinear takes shifts in 1/256 pixel");
+
+    P * currs[OFO_PYRAMID_LEVELS];
+    P * lasts[OFO_PYRAMID_LEVELS];
+
+    if (levels > OFO_PYRAMID_LEVELS)
+        levels = OFO_PYRAMID_LEVELS;
+
+    while (levels > 1 && ((rows >> (levels-1)) < OFO_PYRAMID_MIN || (cols >> (levels-1)) < OFO_PYRAMID_MIN))
+        levels--;
+
+    // the shifted previous image comes first in the work buffer, then the pyramids
+    P * warped = work;
+    P * next = work + (uint32_t)rows*cols;
+
+    currs[0] = curr_img;
+    lasts[0] = last_img;
+
+    for (uint8_t l=1; l<levels; ++l) {
+        uint32_t size = (uint32_t)(rows>>l) * (cols>>l);
+        currs[l] = next;
+        lasts[l] = next + size;
+        next += 2*size;
+        imgDownsample2x2(currs[l-1], rows>>(l-1), cols>>(l-1), currs[l]);
+        imgDownsample2x2(lasts[l-1], rows>>(l-1), cols>>(l-1), lasts[l]);
+    }
+
+    // motion from previous to current image, in pixels of the current level with 
+    // OFO_QBITS fractional bits: curr(x) = last(x - d)
+    int32_t dx = 0;
+    int32_t dy = 0;
+
+    for (int8_t l=levels-1; l>=0; --l) {
+
+        uint16_t R = rows >> l;
+        uint16_t C = cols >> l;
+
+        for (uint8_t k=0; k<iterations; ++k) {
+
+            imgWarpBilinear(lasts[l], R, C, dx * (1 << (8-OFO_QBITS)), dy * (1 << (8-OFO_QBITS)), warped);
+
+            // leave out the border shifted in from outside the image
+            uint16_t mx = (uint16_t)(((dx < 0 ? -dx : dx) + (1<<OFO_QBITS) - 1) >> OFO_QBITS);
+            uint16_t my = (uint16_t)(((dy < 0 ? -dy : dy) + (1<<OFO_QBITS) - 1) >> OFO_QBITS);
+
+            if (2*mx+2 > C || 2*my+2 > R)
+                break;
+
+            flowsums_t sums;
+            ofoSums_Plus_2D<P,BITS>(ImageView<P>(currs[l], R, C).window(my, mx, R-2*my, C-2*mx), 
+                            ImageView<P>(warped, R, C).window(my, mx, R-2*my, C-2*mx), &sums);
+
+            // image-interpolation shift is minus the remaining motion
+            int16_t ix, iy;
+            if (!ofoIIA_SolveFixed(&sums, &ix, &iy, threshold))
+                break;
+
+            // cut a step of more than a pixel to a pixel, keeping its direction
+            const int16_t ax = ix < 0 ? -ix : ix;
+            const int16_t ay = iy < 0 ? -iy : iy;
+            const int16_t step = ax > ay ? ax : ay;
+            if (step > (1<<OFO_QBITS)) {
+                ix = (int16_t)((int32_t)ix * (1<<OFO_QBITS) / step);
+                iy = (int16_t)((int32_t)iy * (1<<OFO_QBITS) / step);
+            }
+
+            dx -= ix;
+            dy -= iy;
+
+            if (ix == 0 && iy == 0)
+                break;
+        }
+
+        // next level has twice the pixels per unit of motion
+        if (l > 0) {
+            dx *= 2;
+            dy *= 2;
+        }
+    }
+
+    // Lucas-Kanade shift is minus half the motion
+    *ofx = (int16_t)(-((int64_t)dx * scale) / (2 << OFO_QBITS));
+    *ofy = (int16_t)(-((int64_t)dy * scale) / (2 << OFO_QBITS));
+}
+
+/**
+ * Computes optical flow on a grid of patches that tile an image, skipping patches
+ * without enough texture to give a reliable flow.  A patch whose confidence (see 
+ * ofoConfidenceFixed) falls below the threshold gets zero flow, and on the following 
+ * frames its sums are not even accumulated: it is tested again only once every 
+ * few frames.  In scenes where most patches are textureless this removes most of 
+ * the work of each frame.  For example,
+ *
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>FlowGrid<uint8_t, 4, 4> grid(OFO_LK_SQUARE, 100, 2000);</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>grid.update(ImageView<uint8_t>(curr, 48, 64), ImageView<uint8_t>(last, 48, 64));</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>if (grid.getFlow(1, 2, &ofx, &ofy)) ...</tt><br>
+ *
+ * @param P pixel type
+ * @param GRIDROWS number of rows of patches
+ * @param GRIDCOLS number of columns of patches
+ * @param BITS number of bits spanned by pixel values
+ */
+template <typename P, uint8_t GRIDROWS, uint8_t GRIDCOLS, uint8_t BITS=8*sizeof(P)>
+class FlowGrid {
+
+    private:
+
+        uint8_t  _method;
+        uint16_t _scale;
+        uint32_t _threshold;
+        uint8_t  _retest;
+        bool     _keep;
+
+        int16_t  _ofx[GRIDROWS][GRIDCOLS];
+        int16_t  _ofy[GRIDROWS][GRIDCOLS];
+        uint32_t _confidence[GRIDROWS][GRIDCOLS];
+        bool     _valid[GRIDROWS][GRIDCOLS];
+
+        // number of frames until a textureless patch is tested again
+        uint8_t  _wait[GRIDROWS][GRIDCOLS];
+
+        uint16_t _active;
+
+        // Returns true if a patch is to be tested this frame; otherwise counts down
+        // its wait and gives it zero flow
+        bool due(uint8_t i, uint8_t j)
+        {
+            if (!_wait[i][j])
+                return true;
+
+            _wait[i][j]--;
+            _ofx[i][j] = 0;
+            _ofy[i][j] = 0;
+            _valid[i][j] = false;
+            return false;
+        }
+
+        // Solves a patch from its sums, making it wait if it lacks texture
+        void solve(uint8_t i, uint8_t j, flowsums_t * sums)
+        {
+            const bool lk = _method == OFO_LK_PLUS || _method == OFO_LK_SQUARE;
+
+            // confidence only when it is needed, and then in 32 bits
+            _confidence[i][j] = (_threshold || _keep) ? ofoConfidenceFixed(sums) : 0;
+
+            if (_confidence[i][j] < _threshold) {
+                _ofx[i][j] = 0;
+                _ofy[i][j] = 0;
+                _valid[i][j] = false;
+            }
+            else
+                _valid[i][j] = lk ?
+                    ofoLK_Solve(sums, _scale, &_ofx[i][j], &_ofy[i][j]) :
+                    ofoIIA_Solve(sums, _scale, &_ofx[i][j], &_ofy[i][j]);
+
+            if (_valid[i][j])
+                _active++;
+            else
+                _wait[i][j] = _retest - 1;
+        }
+
+    public:
+
+        /**
+          * Constructs a grid with every patch to be tested on the first frame.
+          * @param method OFO_IIA_PLUS, OFO_IIA_SQUARE, OFO_LK_PLUS, or OFO_LK_SQUARE
+          * @param scale value of one pixel of motion (for scaling output)
+          * @param threshold minimum confidence for solving a patch; zero solves every patch
+          * @param retest number of frames between tests of a textureless patch
+          * @param confidence if true, the confidence of each patch is computed even 
+          * when the threshold is zero, for getConfidence()
+          */
+        FlowGrid(uint8_t method, uint16_t scale, uint32_t threshold, uint8_t retest=8, bool confidence=false) :
+            _method(method), _scale(scale), _threshold(threshold), _retest(retest ? retest : 1), 
+            _keep(confidence), _active(0)
+        {
+            for (uint8_t i=0; i<GRIDROWS; ++i) {
+                for (uint8_t j=0; j<GRIDCOLS; ++j) {
+                    _ofx[i][j] = 0;
+                    _ofy[i][j] = 0;
+                    _confidence[i][j] = 0;
+                    _valid[i][j] = false;
+                    _wait[i][j] = 0;
+                }
+            }
+        }
+
+        /**
+          * Computes the flow of each patch that is due to be tested.  The image is 
+          * divided into GRIDROWS x GRIDCOLS equal patches, leaving out any remainder
+          * at the bottom and right.
+          * @param curr current image
+          * @param last previous image, with the same number of rows and columns
+          */
+        void update(ImageView<P> curr, ImageView<P> last)
+        {
+            const uint16_t pr = curr.rows() / GRIDROWS;
+            const uint16_t pc = curr.cols() / GRIDCOLS;
+
+            const bool square = _method == OFO_IIA_SQUARE || _method == OFO_LK_SQUARE;
+
+            _active = 0;
+
+            for (uint8_t i=0; i<GRIDROWS; ++i) {
+                for (uint8_t j=0; j<GRIDCOLS; ++j) {
+
+                    if (!due(i, j))
+                        continue;
+
+                    ImageView<P> c = curr.window(i*pr, j*pc, pr, pc);
+                    ImageView<P> l = last.window(i*pr, j*pc, pr, pc);
+
+                    flowsums_t sums;
+                    if (square)
+                        ofoSums_Square_2D<P,BITS>(c, l, &sums);
+                    else
+                        ofoSums_Plus_2D<P,BITS>(c, l, &sums);
+
+                    solve(i, j, &sums);
+                }
+            }
+        }
+
+        /**
+          * Same as above, with the sums of each patch taken from the cached gradients
+          * of a GradientRing, so that the gradients of each image are computed once
+          * however many grids, patches, and baselines use them.  The pixel 
+          * configuration is that of the ring's gradients, whatever the method.
+          * @param ring images and their gradients
+          * @param k how many images back to compare the newest image with
+          */
+        template <uint8_t N, uint16_t ROWS, uint16_t COLS, bool SQUARE, typename G>
+        void update(GradientRing<P, N, ROWS, COLS, SQUARE, G, BITS> & ring, uint8_t k=1)
+        {
+            const uint16_t pr = ROWS / GRIDROWS;
+            const uint16_t pc = COLS / GRIDCOLS;
+
+            _active = 0;
+
+            for (uint8_t i=0; i<GRIDROWS; ++i) {
+                for (uint8_t j=0; j<GRIDCOLS; ++j) {
+                    if (due(i, j)) {
+                        flowsums_t sums;
+                        ring.sums(i*pr, j*pc, pr, pc, k, &sums);
+                        solve(i, j, &sums);
+                    }
+                }
+            }
+        }
+
+        /**
+          * Gets the flow of a patch from the last update().
+          * @param row row of patch
+          * @param col column of patch
+          * @param ofx gets the X shift, zero for a skipped or textureless patch
+          * @param ofy gets the Y shift
+          * @return true if the patch was solved
+          */
+        bool getFlow(uint8_t row, uint8_t col, int16_t * ofx, int16_t * ofy)
+        {
+            *ofx = _ofx[row][col];
+            *ofy = _ofy[row][col];
+            return _valid[row][col];
+        }
+
+        /**
+          * Returns the confidence of a patch when it was last tested, as computed by
+          * ofoConfidenceFixed.  The confidence is computed only when the grid has a 
+          * threshold or was constructed to keep it; otherwise it is zero.
+          * @param row row of patch
+          * @param col column of patch
+          * @return confidence
+          */
+        uint32_t getConfidence(uint8_t row, uint8_t col)
+        {
+            return _confidence[row][col];
+        }
+
+        /**
+          * Returns the number of patches solved by the last update().
+          * @return number of patches
+          */
+        uint16_t getActive(void)
+        {
+            return _active;
+        }
+};
+
+/**
+ * Computes the census transform of an image, for ofoHamming_2D().  Each pixel
+ * gets an eight-bit signature with one bit for each of its eight neighbors, set 
+ * when the neighbor is darker than the pixel.  Pixels on the border of the image 
+ * get a signature of zero.
+ *
+ * @param img image
+ * @param census gets the signatures, rows*cols bytes with no gaps between rows
+ */
+template <typename P>
+void ofoCensus_2D(ImageView<P> img, uint8_t * census)
+{
+    const uint16_t R = img.rows();
+    const uint16_t C = img.cols();
+
+    for (uint16_t r=0; r<R; ++r) {
+
+        uint8_t * out = census + (uint32_t)r*C;
+
+        if (r == 0 || r == R-1) {
+            for (uint16_t c=0; c<C; ++c)
+                out[c] = 0;
+            continue;
+        }
+
+        const P * above = img.row(r-1);
+        const P * here  = img.row(r);
+        const P * below = img.row(r+1);
+
+        out[0] = 0;
+
+        for (uint16_t c=1; c<C-1; ++c) {
+            const P p = here[c];
+            out[c] = 
+                (above[c-1] < p)      | ((above[c] < p) << 1) | ((above[c+1] < p) << 2) | 
+                ((here[c-1] < p) << 3)                        | ((here[c+1] < p) << 4)  |
+                ((below[c-1] < p) << 5) | ((below[c] < p) << 6) | ((below[c+1] < p) << 7);
+        }
+
+        if (C > 1)
+            out[C-1] = 0;
+    }
+}
+
+template <typename P>
+void ofoCensus_2D(P * img, uint16_t rows, uint16_t cols, uint8_t * census)
+{
+    ofoCensus_2D(ImageView<P>(img, rows, cols), census);
+}
+
+// Sum of absolute differences between a square block of the current image and the
+// block of the previous image at (row,col), stopping early once it reaches limit
+template <typename P>
+uint32_t ofo_sad(ImageView<P> block, ImageView<P> last, uint16_t row, uint16_t col, uint32_t limit)
+{
+    uint32_t sad = 0;
+
+    for (uint16_t r=0; r<block.rows(); ++r) {
+
+        const P * a = block.row(r);
+        const P * b = last.row(row+r) + col;
+
+        for (uint16_t c=0; c<block.cols(); ++c)
+            sad += a[c] > b[c] ? a[c] - b[c] : b[c] - a[c];
+
+        // checking once a row keeps the inner loop simple
+        if (sad >= limit)
+            break;
+    }
+
+    return sad;
+}
+
+/**
+ * Computes optical flow for a block of the current image by finding the block of 
+ * the previous image with the smallest sum of absolute differences (SAD).  The 
+ * search starts at the displacement predicted by the previous flow and spirals 
+ * outward, so that when the prediction is good the best match is found early and 
+ * the sums for the remaining candidates stop as soon as they exceed it.  The best
+ * match is refined to a fraction of a pixel by fitting a parabola to the sums of 
+ * its neighbors.  Because the search can be centered anywhere, this handles motion 
+ * of many pixels per frame.
+ *
+ * @param curr current image
+ * @param last previous image, with the same number of rows and columns
+ * @param row row of upper-left pixel of block in current image
+ * @param col column of upper-left pixel of block in current image
+ * @param size number of rows and columns of block
+ * @param range largest distance from the prediction tried, in pixels, in each direction
+ * @param scale value of one pixel of motion (for scaling output)
+ * @param ofx on input, the predicted X shift (e.g. the one from the previous frame,
+ * or zero); on output, the X shift, with the same sign and units as from ofoIIA_Square_2D()
+ * @param ofy predicted Y shift on input, Y shift on output
+ * @return false if no candidate block within range lies inside the previous image, 
+ * leaving the shifts unchanged
+ */
+template <typename P>
+bool ofoBlockMatch_2D(ImageView<P> curr, ImageView<P> last, uint16_t row, uint16_t col, uint16_t size, 
+        uint8_t range, uint16_t scale, int16_t * ofx, int16_t * ofy)
+{
+    ImageView<P> block = curr.window(row, col, size, size);
+
+    // largest displacements keeping the previous block inside the image: the block
+    // at (row,col) moved by d came from (row-dy,col-dx)
+    const int32_t xlo = (int32_t)col + size - last.cols();
+    const int32_t xhi = col;
+    const int32_t ylo = (int32_t)row + size - last.rows();
+    const int32_t yhi = row;
+
+    // predicted motion in whole pixels; the image-interpolation shift is minus the motion
+    const int32_t half = scale / 2;
+    const int32_t px = *ofx > 0 ? -((int32_t)*ofx + half) / scale : (-(int32_t)*ofx + half) / scale;
+    const int32_t py = *ofy > 0 ? -((int32_t)*ofy + half) / scale : (-(int32_t)*ofy + half) / scale;
+
+    bool found = false;
+    uint32_t best = 0xFFFFFFFF;
+    int32_t bx = 0;
+    int32_t by = 0;
+
+    // square rings of increasing distance from the prediction
+    for (int16_t k=0; k<=range; ++k) {
+        for (int16_t j=-k; j<=k; ++j) {
+            for (int16_t i=-k; i<=k; i += (j == -k || j == k || k == 0) ? 1 : 2*k) {
+                int32_t dx = px + i;
+                int32_t dy = py + j;
+                if (dx < xlo || dx > xhi || dy < ylo || dy > yhi)
+                    continue;
+                uint32_t sad = ofo_sad(block, last, row-dy, col-dx, best);
+                if (sad < best) {
+                    best = sad;
+                    bx = dx;
+                    by = dy;
+                    found = true;
+                }
+            }
+        }
+    }
+
+    if (!found)
+        return false;
+
+    // motion in units of scale, refined between neighbors that were in the search
+    int32_t mx = bx * scale;
+    int32_t my = by * scale;
+
+    if (bx > px-range && bx < px+range && bx > xlo && bx < xhi) {
+        int32_t cm = ofo_sad(block, last, row-by, col-bx+1, 0xFFFFFFFF);
+        int32_t cp = ofo_sad(block, last, row-by, col-bx-1, 0xFFFFFFFF);
+        int32_t den = 2 * (cm + cp - 2*(int32_t)best);
+        if (den > 0)
+            mx += (int32_t)((int64_t)(cm - cp) * scale / den);
+    }
+
+    if (by > py-range && by < py+range && by > ylo && by < yhi) {
+        int32_t cm = ofo_sad(block, last, row-by+1, col-bx, 0xFFFFFFFF);
+        int32_t cp = ofo_sad(block, last, row-by-1, col-bx, 0xFFFFFFFF);
+        int32_t den = 2 * (cm + cp - 2*(int32_t)best);
+        if (den > 0)
+            my += (int32_t)((int64_t)(cm - cp) * scale / den);
+    }
+
+    *ofx = (int16_t)-mx;
+    *ofy = (int16_t)-my;
+
+    return true;
+}
+
+// Fills the real parts of a work buffer with a window of an image, less its mean 
+// and tapered by the Hann window, and the imaginary parts with zero
+template <typename P>
+void ofo_phase_window(ImageView<P> view, uint8_t n, int16_t * re)
+{
+    const uint16_t nn = (uint16_t)n*n;
+
+    int16_t * im = re + nn;
+
+    uint32_t sum = 0;
+    for (uint8_t r=0; r<n; ++r)
+        for (uint8_t c=0; c<n; ++c)
+            sum += view.row(r)[c];
+    int32_t mean = sum / nn;
+
+    for (uint8_t r=0; r<n; ++r) {
+        int32_t wr = ofo_hann(r, n);
+        for (uint8_t c=0; c<n; ++c) {
+            int32_t v = (((int32_t)view.row(r)[c] - mean) * wr) >> 15;
+            v = (v * ofo_hann(c, n)) >> 15;
+            re[r*n+c] = (int16_t)(v > 32767 ? 32767 : v < -32767 ? -32767 : v);
+            im[r*n+c] = 0;
+        }
+    }
+}
+
+/**
+ * Computes the global shift between two images by phase correlation.  A square 
+ * window at the center of each image is transformed with a fixed-point radix-2 FFT,
+ * the phase difference of the two spectra is transformed back, and the peak of 
+ * the result gives the shift to the nearest pixel.  Because the Hann window tapers
+ * the two images' content differently once it has moved, the fraction found along
+ * with a large shift is pulled toward zero; so the window of the previous image is 
+ * then moved by the whole pixels found, as far as it fits in the image, and the 
+ * fraction found again from the parabola through the peak and its neighbors.  This
+ * takes twice the time of a single correlation.  Because only the phase of each 
+ * frequency is used, the result is unaffected by uniform changes in brightness.  
+ * Shifts of up to a fifth of the window are found to within a quarter pixel, 
+ * given enough texture in the window; the motion should also leave the window 
+ * inside both images.  For images of 10x10 pixels, use an 8x8 window.
+ *
+ * @param curr current image
+ * @param last previous image, with the same number of rows and columns
+ * @param n window size, a power of two from 4 to OFO_PHASECORR_MAX, no larger than 
+ * the images
+ * @param work buffer of 4*n*n values
+ * @param scale value of one pixel of motion (for scaling output)
+ * @param ofx pointer to integer value for X shift, with the same sign as from ofoIIA_Square_2D()
+ * @param ofy pointer to integer value for Y shift
+ * @return false if the window size is not supported
+ */
+template <typename P>
+bool ofoPhaseCorr_2D(ImageView<P> curr, ImageView<P> last, uint8_t n, int16_t * work, 
+        uint16_t scale, int16_t * ofx, int16_t * ofy)
+{
+    if (n < 4 || n > OFO_PHASECORR_MAX || (n & (n-1)) || n > curr.rows() || n > curr.cols())
+        return false;
+
+    const uint16_t nn = (uint16_t)n*n;
+
+    const int16_t row = (curr.rows()-n)/2;
+    const int16_t col = (curr.cols()-n)/2;
+
+    ofo_phase_window(curr.window(row, col, n, n), n, work);
+    ofo_phase_window(last.window(row, col, n, n), n, work + 2*nn);
+    ofo_phase_corr(work, n, scale, ofx, ofy);
+
+    // whole pixels of motion, rounded, limited to what keeps the window in the image
+    const int32_t half = scale / 2;
+    int16_t mx = (int16_t)((*ofx > 0 ? -*ofx - half : -*ofx + half) / (int32_t)scale);
+    int16_t my = (int16_t)((*ofy > 0 ? -*ofy - half : -*ofy + half) / (int32_t)scale);
+    const int16_t lowx = col + n - (int16_t)curr.cols();
+    const int16_t lowy = row + n - (int16_t)curr.rows();
+    mx = mx > col ? col : mx < lowx ? lowx : mx;
+    my = my > row ? row : my < lowy ? lowy : my;
+
+    if (mx == 0 && my == 0)
+        return true;
+
+    // curr(x) = last(x - d), so the previous image's content is at the window less the motion
+    ofo_phase_window(curr.window(row, col, n, n), n, work);
+    ofo_phase_window(last.window(row-my, col-mx, n, n), n, work + 2*nn);
+    ofo_phase_corr(work, n, scale, ofx, ofy);
+
+    *ofx = (int16_t)(*ofx - (int32_t)mx*scale);
+    *ofy = (int16_t)(*ofy - (int32_t)my*scale);
+
+    return true;
+}
+
+/**
+ * Computes a dense optical flow field, one vector per pixel, with the method of 
+ * Horn and Schunck: the flow that best fits the brightness change at each pixel 
+ * while varying smoothly from pixel to pixel.  The field is refined in place by 
+ * red-black Gauss-Seidel sweeps in fixed point, which update half the pixels from 
+ * their four neighbors and then the other half.  Since the field from the previous 
+ * frame is a good start, one or two sweeps per frame are usually enough once the 
+ * motion is steady, and a fixed number of sweeps keeps the time per frame fixed.
+ * The differentials are those of the plus configuration, as in ofoLK_Plus_2D(), 
+ * and pixels should span at most 14 bits.  Best suited to host computers and 
+ * 32-bit microcontrollers, since each pixel needs a 64-bit division per sweep.
+ *
+ * @param curr current image
+ * @param last previous image, with the same number of rows and columns
+ * @param alpha2 smoothness weight, in units of a squared differential: larger values
+ * give smoother fields, and fill in textureless regions from their surroundings
+ * @param iterations number of sweeps
+ * @param u X shift of each pixel, rows*cols values with no gaps between rows and 
+ * OFO_QBITS fractional bits, with the same sign as from ofoIIA_Plus_2D(); holds the 
+ * field to start from (e.g. the previous frame's, or zeros) on input
+ * @param v Y shift of each pixel
+ */
+template <typename P>
+void ofoHornSchunck_2D(ImageView<P> curr, ImageView<P> last, uint32_t alpha2, uint8_t iterations, 
+        int16_t * u, int16_t * v)
+{
+    const uint16_t R = curr.rows();
+    const uint16_t C = curr.cols();
+
+    if (R < 3 || C < 3)
+        return;
+
+    for (uint8_t k=0; k<iterations; ++k) {
+
+        // red pixels, then black
+        for (uint8_t color=0; color<2; ++color) {
+
+            for (uint16_t r=1; r<R-1; ++r) {
+
+                const P * f0 = curr.row(r);
+                const P * fu = curr.row(r-1);
+                const P * fd = curr.row(r+1);
+                const P * fz = last.row(r);
+
+                for (uint16_t c=1+((r+color+1)&1); c<C-1; c+=2) {
+
+                    uint32_t i = (uint32_t)r*C + c;
+
+                    int16_t F2F1 = (f0[c-1] - f0[c+1]);  // horizontal differential
+                    int16_t F4F3 = (fu[c] - fd[c]);      // vertical differential
+                    int16_t FCF0 = (fz[c] - f0[c]);      // time differential
+
+                    // average of the four neighbors, which all have the other color
+                    int32_t ua = ((int32_t)u[i-1] + u[i+1] + u[i-C] + u[i+C] + 2) >> 2;
+                    int32_t va = ((int32_t)v[i-1] + v[i+1] + v[i-C] + v[i+C] + 2) >> 2;
+
+                    // the image-interpolation shift w satisfies F2F1*wx + F4F3*wy = 2*FCF0,
+                    // so the residual of the average is
+                    int32_t e = F2F1*ua + F4F3*va - (int32_t)FCF0 * (1 << (OFO_QBITS+1));
+
+                    int32_t den = (int32_t)alpha2 + (int32_t)F2F1*F2F1 + (int32_t)F4F3*F4F3;
+
+                    if (den > 0) {
+                        ua -= (int32_t)((int64_t)e * F2F1 / den);
+                        va -= (int32_t)((int64_t)e * F4F3 / den);
+                    }
+
+                    u[i] = (int16_t)(ua > 32767 ? 32767 : ua < -32767 ? -32767 : ua);
+                    v[i] = (int16_t)(va > 32767 ? 32767 : va < -32767 ? -32767 : va);
+                }
+            }
+        }
+
+        // border pixels, which have no differentials, follow their inner neighbors
+        for (uint16_t c=1; c<C-1; ++c) {
+            u[c] = u[C+c];
+            v[c] = v[C+c];
+            u[(uint32_t)(R-1)*C+c] = u[(uint32_t)(R-2)*C+c];
+            v[(uint32_t)(R-1)*C+c] = v[(uint32_t)(R-2)*C+c];
+        }
+        for (uint16_t r=0; r<R; ++r) {
+            uint32_t i = (uint32_t)r*C;
+            u[i] = u[i+1];
+            v[i] = v[i+1];
+            u[i+C-1] = u[i+C-2];
+            v[i+C-1] = v[i+C-2];
+        }
+    }
+}
+
+/**
+ * Maximum number of strips whose sums ofoIIA_1D_Batch() accumulates at once
+ */
+static const uint8_t OFO_BATCH_STRIPS = 16;
+
+/**
+ * Runs ofoIIA_1D() on many strips of pixels in one call, e.g. the rows or 
+ * columns of an image, the bands from imgSubwin2Dto1DHorizontal(), or a set of 
+ * row-sum and column-sum projections of the same length.  Pixel i of strip k is 
+ * at k*stripstride + i*pixstride, so the columns of an image with C columns are
+ * strips with a pixstride of C and a stripstride of 1, and the rows are strips 
+ * with a pixstride of 1 and a stripstride of C.  On x86 host computers, strips 
+ * stored next to each other (stripstride of 1) are computed eight or sixteen at a
+ * time with SSE2 or AVX2 instructions, and contiguous strips (pixstride of 1) with
+ * the vector version of ofoIIA_1D(); the results are the same as on the Arduino.
+ * As with ofoLK_Plus_2D(), a second template parameter gives the number of bits 
+ * the pixels span, e.g. ofoIIA_1D_Batch<uint16_t, 10>(...) for pixels from the
+ * Arduino ADC.  Sixteen-bit values that span all 16 bits, such as row-sum 
+ * projections of large images, are summed exactly, but with 64-bit products.
+ *
+ * @param curr_img first pixel of first strip of current image
+ * @param last_img first pixel of first strip of previous image
+ * @param numpix number of pixels in each strip
+ * @param pixstride distance between neighboring pixels of a strip
+ * @param numstrips number of strips
+ * @param stripstride distance between the first pixels of neighboring strips
+ * @param scale value of one pixel of motion (for scaling output)
+ * @param out gets the shift of each strip, zero for strips with no texture
+ */
+template <typename P, uint8_t BITS=8*sizeof(P)>
+void ofoIIA_1D_Batch(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, uint16_t scale, int16_t * out)
+{
+    int32_t top[OFO_BATCH_STRIPS];
+    int32_t bottom[OFO_BATCH_STRIPS];
+
+    for (uint16_t k=0; k<numstrips; k+=OFO_BATCH_STRIPS) {
+
+        uint16_t n = numstrips - k < OFO_BATCH_STRIPS ? numstrips - k : OFO_BATCH_STRIPS;
+
+        const uint32_t offset = (uint32_t)k*stripstride;
+
+        ofo_sums_1d_wide<BITS>(curr_img + offset, last_img + offset, numpix, pixstride, n, stripstride, top, bottom);
+
+        for (uint16_t j=0; j<n; ++j)
+            out[k+j] = ofoIIA_1D_Solve(top[j], bottom[j], scale);
+    }
+}
+
+/**
+ * Integrates optical flow into a two-dimensional displacement, as ofoAccumulate()
+ * does for one axis, and keeps the most recent N per-frame displacements with their 
+ * times for estimating velocity.  Flow within a dead band of zero is ignored, so 
+ * that noise does not make the displacement drift while the sensor is still.  The
+ * displacement is kept in 32 bits with OFO_QBITS fractional bits, so calibrating 
+ * the flow by a fractional scale loses nothing from frame to frame.  Every update 
+ * takes the same time and no memory is allocated, so it can run at the full frame 
+ * rate inside the acquisition loop.  For example,
+ *
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>Odometry<16> odometry(4);</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>odometry.update(micros(), ofx, ofy);</tt><br>
+ * &nbsp;&nbsp;&nbsp;&nbsp;<tt>odometry.getVelocity(8, 1000000, &vx, &vy);  // per second</tt><br>
+ *
+ * @param N number of recent samples kept for velocity
+ */
+template <uint8_t N>
+class Odometry {
+
+    private:
+
+        int16_t _deadband;
+        int16_t _scalex;
+        int16_t _scaley;
+
+        int32_t _x;
+        int32_t _y;
+
+        // recent samples, newest at _newest
+        uint32_t _time[N];
+        int32_t  _dx[N];
+        int32_t  _dy[N];
+        uint8_t  _newest;
+        uint8_t  _count;
+
+        // displacement scaled by calibration, with OFO_QBITS fractional bits, 
+        // or zero within the dead band
+        int32_t calibrate(int16_t flow, int16_t scale)
+        {
+            return (flow > _deadband || flow < -_deadband) ? (int32_t)flow * scale : 0;
+        }
+
+    public:
+
+        /**
+          * Constructs an integrator with no displacement and a calibration of one.
+          * @param deadband flow values from -deadband to deadband are ignored
+          */
+        Odometry(int16_t deadband=0) : _deadband(deadband) 
+        {
+            setScale(1 << OFO_QBITS, 1 << OFO_QBITS);
+            reset();
+        }
+
+        /**
+          * Sets the calibration of each axis, e.g. to convert flow to distance traveled.
+          * @param scalex value multiplying X flow, with OFO_QBITS fractional bits; 
+          * negative to reverse the axis
+          * @param scaley value multiplying Y flow
+          */
+        void setScale(int16_t scalex, int16_t scaley)
+        {
+            _scalex = scalex;
+            _scaley = scaley;
+        }
+
+        /**
+          * Sets the dead band.
+          * @param deadband flow values from -deadband to deadband are ignored
+          */
+        void setDeadband(int16_t deadband)
+        {
+            _deadband = deadband;
+        }
+
+        /**
+          * Sets the displacement to zero and forgets the recent samples.
+          */
+        void reset(void)
+        {
+            _x = 0;
+            _y = 0;
+            _newest = N-1;
+            _count = 0;
+        }
+
+        /**
+          * Adds the flow of a frame to the displacement.
+          * @param time time of the frame, e.g. from micros(); may wrap around
+          * @param ofx X flow
+          * @param ofy Y flow
+          * @return true if the flow was outside the dead band on either axis
+          */
+        bool update(uint32_t time, int16_t ofx, int16_t ofy)
+        {
+            int32_t dx = calibrate(ofx, _scalex);
+            int32_t dy = calibrate(ofy, _scaley);
+
+            _x += dx;
+            _y += dy;
+
+            _newest = (_newest + 1) % N;
+            _time[_newest] = time;
+            _dx[_newest] = dx;
+            _dy[_newest] = dy;
+
+            if (_count < N)
+                _count++;
+
+            return dx || dy;
+        }
+
+        /**
+          * Adds the average flow of several patches (e.g. from FlowGrid or ofoLK_Grid()) 
+          * to the displacement.
+          * @param time time of the frame
+          * @param ofx X flow of each patch
+          * @param ofy Y flow of each patch
+          * @param count number of patches
+          * @return true if the average flow was outside the dead band on either axis
+          */
+        bool update(uint32_t time, const int16_t * ofx, const int16_t * ofy, uint16_t count)
+        {
+            int32_t sx = 0;
+            int32_t sy = 0;
+
+            for (uint16_t k=0; k<count; ++k) {
+                sx += ofx[k];
+                sy += ofy[k];
+            }
+
+            return count ? update(time, (int16_t)(sx / count), (int16_t)(sy / count)) : update(time, 0, 0);
+        }
+
+        /**
+          * Returns the X displacement since the last reset().
+          * @return displacement, in units of the calibrated flow
+          */
+        int32_t getX(void)
+        {
+            return _x >> OFO_QBITS;
+        }
+
+        /**
+          * Returns the Y displacement since the last reset().
+          * @return displacement, in units of the calibrated flow
+          */
+        int32_t getY(void)
+        {
+            return _y >> OFO_QBITS;
+        }
+
+        /**
+          * Returns the number of recent samples kept, up to N.
+          * @return number of samples
+          */
+        uint8_t getCount(void)
+        {
+            return _count;
+        }
+
+        /**
+          * Estimates velocity from the recent samples: the displacement over the last
+          * k frames divided by the time from the frame before them to the newest.
+          * @param k number of frames, from 1 to getCount()-1
+          * @param per unit of time for the velocity, in units of the sample times 
+          * (e.g. 1000000 for per second, with times from micros())
+          * @param vx gets X velocity, in units of the calibrated flow per unit of time
+          * @param vy gets Y velocity
+          * @return false, leaving the velocity unchanged, if there are not k+1 samples
+          * or no time has passed
+          */
+        bool getVelocity(uint8_t k, uint32_t per, int32_t * vx, int32_t * vy)
+        {
+            if (k == 0 || k >= _count)
+                return false;
+
+            int32_t sx = 0;
+            int32_t sy = 0;
+
+            for (uint8_t j=0; j<k; ++j) {
+                uint8_t s = (_newest + N - j) % N;
+                sx += _dx[s];
+                sy += _dy[s];
+            }
+
+            // unsigned difference is correct across a wraparound of the clock
+            uint32_t elapsed = _time[_newest] - _time[(_newest + N - k) % N];
+
+            if (elapsed == 0)
+                return false;
+
+            *vx = (int32_t)((int64_t)sx * per / elapsed / (1 << OFO_QBITS));
+            *vy = (int32_t)((int64_t)sy * per / elapsed / (1 << OFO_QBITS));
+
+            return true;
+        }
+};
+
+/**
+ * Computes optical flow with a method chosen at run time, e.g. by ofoAutotune().
+ * As with ofoLK_Plus_2D(), a second template parameter can give the number of 
+ * bits the pixels span, e.g. ofoFlow_2D<uint16_t, 11>(...).
+ *
+ * @param curr current image
+ * @param last previous image, with the same number of rows and columns
+ * @param method OFO_IIA_PLUS, OFO_IIA_SQUARE, OFO_LK_PLUS, or OFO_LK_SQUARE
+ * @param scale value of one pixel of motion (for scaling output)
+ * @param ofx pointer to integer value for X shift
+ * @param ofy pointer to integer value for Y shift
+ * @param sums if not NULL, gets the sums the shift was solved from
+ * @return false if the shift was set to zero for lack of texture
+ */
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoFlow_2D(ImageView<P> curr, ImageView<P> last, uint8_t method, uint16_t scale, 
+        int16_t * ofx, int16_t * ofy, flowsums_t * sums=NULL)
+{
+    flowsums_t local;
+    if (!sums)
+        sums = &local;
+
+    if (method == OFO_IIA_SQUARE || method == OFO_LK_SQUARE)
+        ofoSums_Square_2D<P,BITS>(curr, last, sums);
+    else
+        ofoSums_Plus_2D<P,BITS>(curr, last, sums);
+
+    return (method == OFO_LK_PLUS || method == OFO_LK_SQUARE) ?
+        ofoLK_Solve(sums, scale, ofx, ofy) :
+        ofoIIA_Solve(sums, scale, ofx, ofy);
+}
+
+/**
+ * Maximum number of rows and columns of patches tried by ofoAutotune()
+ */
+static const uint8_t OFO_TUNE_GRID = 4;
+
+/**
+ * Chooses the flow method and grid of patches for a pair of live images, by 
+ * timing each of the four methods on a single patch and on grids of 2x2 and 
+ * 4x4 patches.  The quality of each configuration is the fraction of the 
+ * brightness change between the images that its flows leave unexplained (the 
+ * residual of the equations the methods solve), so the images should have some
+ * motion.  Among the configurations that fit in the time budget, the fastest 
+ * one whose residual is within an eighth of the best is chosen; if none fits, 
+ * the fastest.  Only the flows are timed; the residual is computed afterward,
+ * untimed.  Tuning takes about 12*(repeats+1) times the flow of a frame, so it 
+ * is meant for startup, with the result saved by ofoTuningSave().  As with 
+ * ofoFlow_2D(), a second template parameter can give the number of bits the 
+ * pixels span.
+ *
+ * @param curr current image
+ * @param last previous image, with the same number of rows and columns
+ * @param budget time per frame allowed for flow, in microseconds
+ * @param usec clock giving the time in microseconds, e.g. micros
+ * @param repeats number of times each configuration is timed
+ * @param tuning gets the chosen configuration
+ * @return false if the images are too small to tune (fewer than four rows or 
+ * columns), leaving the tuning at OFO_IIA_PLUS on a single patch
+ */
+template <typename P, uint8_t BITS=8*sizeof(P)>
+bool ofoAutotune(ImageView<P> curr, ImageView<P> last, uint32_t budget, unsigned long (*usec)(void), 
+        uint8_t repeats, FlowTuning * tuning)
+{
+    const uint8_t methods[4] = {OFO_IIA_PLUS, OFO_IIA_SQUARE, OFO_LK_PLUS, OFO_LK_SQUARE};
+
+    FlowTuning results[4*3];
+    uint8_t count = 0;
+
+    memset(results, 0, sizeof(results));
+
+    if (repeats == 0)
+        repeats = 1;
+
+    for (uint8_t g=1; g<=OFO_TUNE_GRID; g*=2) {
+
+        const uint16_t pr = curr.rows() / g;
+        const uint16_t pc = curr.cols() / g;
+
+        // the plus configuration needs at least three rows and columns
+        if (pr < 4 || pc < 4)
+            break;
+
+        for (uint8_t m=0; m<4; ++m) {
+
+            const uint8_t method = methods[m];
+            const uint16_t scale = 256;
+
+            // time the flows alone
+            unsigned long start = usec();
+
+            for (uint8_t k=0; k<repeats; ++k) {
+                for (uint8_t i=0; i<g; ++i) {
+                    for (uint8_t j=0; j<g; ++j) {
+                        int16_t ofx, ofy;
+                        ofoFlow_2D<P,BITS>(curr.window(i*pr, j*pc, pr, pc), last.window(i*pr, j*pc, pr, pc), 
+                                method, scale, &ofx, &ofy);
+                    }
+                }
+            }
+
+            const uint32_t elapsed = (uint32_t)(usec() - start);
+
+            // then, untimed, the residual, with the flows computed again rather than 
+            // kept; both kinds of solution are converted to that of Lucas-Kanade, 
+            // which is what the sums describe
+            float unexplained = 0;
+            float total = 0;
+
+            for (uint8_t i=0; i<g; ++i) {
+                for (uint8_t j=0; j<g; ++j) {
+
+                    ImageView<P> c = curr.window(i*pr, j*pc, pr, pc);
+                    ImageView<P> l = last.window(i*pr, j*pc, pr, pc);
+
+                    int16_t ofx, ofy;
+                    flowsums_t sums;
+                    ofoFlow_2D<P,BITS>(c, l, method, scale, &ofx, &ofy, &sums);
+
+                    // sum of squared time differentials, at the positions the sums use
+                    const bool square = method == OFO_IIA_SQUARE || method == OFO_LK_SQUARE;
+                    float dtdt = 0;
+                    for (uint16_t r=square?0:1; r<pr-1; ++r) {
+                        for (uint16_t q=square?0:1; q<pc-1; ++q) {
+                            float dt = (float)l.row(r)[q] - (float)c.row(r)[q];
+                            dtdt += dt*dt;
+                        }
+                    }
+
+                    const float k2 = (method == OFO_LK_PLUS || method == OFO_LK_SQUARE) ? scale : 2.0f*scale;
+                    const float sx = ofx / k2;
+                    const float sy = ofy / k2;
+
+                    float e = dtdt - 2*(sx*sums.b1 + sy*sums.b2) + 
+                        sx*sx*sums.A11 + 2*sx*sy*sums.A12 + sy*sy*sums.A22;
+
+                    unexplained += e > 0 ? e : 0;
+                    total += dtdt;
+                }
+            }
+
+            FlowTuning & t = results[count++];
+            t.method = method;
+            t.grid = g;
+            t.rows = curr.rows();
+            t.cols = curr.cols();
+            t.usec = elapsed / repeats;
+
+            // flows far off the mark can leave more than 256 times the change unexplained;
+            // 0xFFFF is kept to mean no residual in budget, below
+            const float ratio = total > 0 ? 256 * unexplained / total : 0;
+            t.residual = ratio < 0xFFFE ? (uint16_t)ratio : 0xFFFE;
+        }
+    }
+
+    if (count == 0) {
+        memset(tuning, 0, sizeof(FlowTuning));
+        tuning->method = OFO_IIA_PLUS;
+        tuning->grid = 1;
+        tuning->rows = curr.rows();
+        tuning->cols = curr.cols();
+        tuning->check = ofoTuningCheck(tuning);
+        return false;
+    }
+
+    // best residual among those in budget
+    uint16_t best = 0xFFFF;
+    for (uint8_t k=0; k<count; ++k)
+        if (results[k].usec <= budget && results[k].residual < best)
+            best = results[k].residual;
+
+    // fastest within an eighth of it, or fastest of all
+    uint8_t choice = 0xFF;
+    for (uint8_t k=0; k<count; ++k) {
+        const FlowTuning & t = results[k];
+        bool eligible = best == 0xFFFF || (t.usec <= budget && t.residual <= best + best/8);
+        if (eligible && (choice == 0xFF || t.usec < results[choice].usec))
+            choice = k;
+    }
+
+    *tuning = results[choice];
+    tuning->check = ofoTuningCheck(tuning);
+
+    return true;
+}
@@ -0,0 +1,534 @@
+/*
+   OpticalFlowSIMD.cpp SSE2 and AVX2 versions of the optical flow sums, for
+   host computers with x86 processors
+
+   Copyright (c) 2012 Centeye, Inc.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY CENTEYE, INC. ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+   EVENT SHALL CENTEYE, INC. OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+   OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   The views and conclusions contained in the software and documentation are
+   those of the authors and should not be interpreted as representing official
+   policies, either expressed or implied, of Centeye, Inc.
+ */
+
+#include <OpticalFlow.h>
+
+#ifdef OFO_SIMD
+
+#include <immintrin.h>
+
+// The vector versions compute the differentials in sixteen-bit lanes, which wrap
+// exactly as the generic versions' int16_t differentials do, and accumulate the
+// products in 32-bit lanes with pmaddwd.  Since integer addition modulo 2^32 does
+// not depend on order, the sums are identical to the generic versions'.  Pixels
+// at the ends of each row that do not fill a vector are handled one at a time.
+
+// Adds the n 32-bit lanes of each of the five accumulators to the one-at-a-time
+// sums, modulo 2^32
+static void store_sums(const uint32_t * lanes, uint8_t n, const uint32_t tail[5], flowsums_t * sums)
+{
+    uint32_t total[5];
+
+    for (uint8_t k=0; k<5; ++k) {
+        total[k] = tail[k];
+        for (uint8_t i=0; i<n; ++i)
+            total[k] += lanes[k*n+i];
+    }
+
+    sums->A11 = (int32_t)total[0];
+    sums->A12 = (int32_t)total[1];
+    sums->A22 = (int32_t)total[2];
+    sums->b1  = (int32_t)total[3];
+    sums->b2  = (int32_t)total[4];
+}
+
+// Adds the products of one pixel's differentials to the one-at-a-time sums
+static inline void add_products(uint32_t tail[5], int16_t x, int16_t y, int16_t t)
+{
+    tail[0] += (uint32_t)((int32_t)x * x);
+    tail[1] += (uint32_t)((int32_t)y * x);
+    tail[2] += (uint32_t)((int32_t)y * y);
+    tail[3] += (uint32_t)((int32_t)t * x);
+    tail[4] += (uint32_t)((int32_t)t * y);
+}
+
+// Differentials of one pixel, as the generic versions compute them
+template <typename P>
+static inline void tail_plus(const P * f, const P * z, uint16_t S, uint32_t tail[5])
+{
+    add_products(tail, (int16_t)(f[-1] - f[1]), (int16_t)(f[-S] - f[S]), (int16_t)(*z - *f));
+}
+
+template <typename P>
+static inline void tail_square(const P * f, const P * z, uint16_t S, uint32_t tail[5])
+{
+    add_products(tail,
+            (int16_t)((f[0] - f[1]) + (f[S] - f[S+1])),
+            (int16_t)((f[0] - f[S]) + (f[1] - f[S+1])),
+            (int16_t)(*z - *f));
+}
+
+/*********************************************************************/
+// SSE2: eight pixels at a time
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+static inline __m128i load8(const uint8_t * p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+}
+
+static inline __m128i load8(const uint16_t * p)
+{
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline void madd8(__m128i acc[5], __m128i x, __m128i y, __m128i t)
+{
+    acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(x, x));
+    acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(y, x));
+    acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(y, y));
+    acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(t, x));
+    acc[4] = _mm_add_epi32(acc[4], _mm_madd_epi16(t, y));
+}
+
+static void store8(const __m128i acc[5], const uint32_t tail[5], flowsums_t * sums)
+{
+    uint32_t lanes[5][4];
+
+    for (uint8_t k=0; k<5; ++k)
+        _mm_storeu_si128((__m128i *)lanes[k], acc[k]);
+
+    store_sums(lanes[0], 4, tail, sums);
+}
+
+template <typename P>
+static void sums_plus_sse2(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    __m128i acc[5];
+    for (uint8_t k=0; k<5; ++k)
+        acc[k] = _mm_setzero_si128();
+
+    uint32_t tail[5] = {0, 0, 0, 0, 0};
+
+    for (uint16_t r=1; r<rows-1; ++r) {
+
+        const P * f = curr_img + (uint32_t)r*curr_stride;
+        const P * z = last_img + (uint32_t)r*last_stride;
+
+        uint16_t c = 1;
+
+        for (; c+8 < cols; c+=8) {
+            __m128i x = _mm_sub_epi16(load8(f+c-1), load8(f+c+1));
+            __m128i y = _mm_sub_epi16(load8(f+c-curr_stride), load8(f+c+curr_stride));
+            __m128i t = _mm_sub_epi16(load8(z+c), load8(f+c));
+            madd8(acc, x, y, t);
+        }
+
+        for (; c<cols-1; ++c)
+            tail_plus(f+c, z+c, curr_stride, tail);
+    }
+
+    store8(acc, tail, sums);
+}
+
+template <typename P>
+static void sums_square_sse2(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    __m128i acc[5];
+    for (uint8_t k=0; k<5; ++k)
+        acc[k] = _mm_setzero_si128();
+
+    uint32_t tail[5] = {0, 0, 0, 0, 0};
+
+    for (uint16_t r=0; r<rows-1; ++r) {
+
+        const P * f = curr_img + (uint32_t)r*curr_stride;
+        const P * z = last_img + (uint32_t)r*last_stride;
+
+        uint16_t c = 0;
+
+        for (; c+8 < cols; c+=8) {
+            __m128i f0 = load8(f+c);
+            __m128i f1 = load8(f+c+1);
+            __m128i f2 = load8(f+c+curr_stride);
+            __m128i f3 = load8(f+c+curr_stride+1);
+            __m128i x = _mm_add_epi16(_mm_sub_epi16(f0, f1), _mm_sub_epi16(f2, f3));
+            __m128i y = _mm_add_epi16(_mm_sub_epi16(f0, f2), _mm_sub_epi16(f1, f3));
+            __m128i t = _mm_sub_epi16(load8(z+c), f0);
+            madd8(acc, x, y, t);
+        }
+
+        for (; c<cols-1; ++c)
+            tail_square(f+c, z+c, curr_stride, tail);
+    }
+
+    store8(acc, tail, sums);
+}
+
+static void sums_1d_sse2(const pixel_t * curr_img, const pixel_t * last_img, uint16_t numpix, int32_t * top, int32_t * bottom)
+{
+    __m128i tacc = _mm_setzero_si128();
+    __m128i bacc = _mm_setzero_si128();
+
+    uint32_t t32 = 0, b32 = 0;
+
+    uint16_t i = 1;
+
+    for (; i+8 < numpix; i+=8) {
+        __m128i dx = _mm_sub_epi16(load8(curr_img+i+1), load8(curr_img+i-1));
+        __m128i dt = _mm_sub_epi16(load8(last_img+i), load8(curr_img+i));
+        tacc = _mm_add_epi32(tacc, _mm_madd_epi16(dt, dx));
+        bacc = _mm_add_epi32(bacc, _mm_madd_epi16(dx, dx));
+    }
+
+    for (; i<numpix-1; ++i) {
+        int32_t dx = (int32_t)curr_img[i+1] - curr_img[i-1];
+        int32_t dt = (int32_t)last_img[i] - curr_img[i];
+        t32 += (uint32_t)(dt * dx);
+        b32 += (uint32_t)(dx * dx);
+    }
+
+    uint32_t lanes[2][4];
+    _mm_storeu_si128((__m128i *)lanes[0], tacc);
+    _mm_storeu_si128((__m128i *)lanes[1], bacc);
+
+    for (uint8_t k=0; k<4; ++k) {
+        t32 += lanes[0][k];
+        b32 += lanes[1][k];
+    }
+
+    *top    = (int32_t)t32;
+    *bottom = (int32_t)b32;
+}
+
+// Products of sixteen-bit lanes as 32-bit lanes: lanes 0-3, then 4-7
+static inline void mul32(__m128i a, __m128i b, __m128i * lo, __m128i * hi)
+{
+    __m128i l = _mm_mullo_epi16(a, b);
+    __m128i h = _mm_mulhi_epi16(a, b);
+    *lo = _mm_unpacklo_epi16(l, h);
+    *hi = _mm_unpackhi_epi16(l, h);
+}
+
+// 1D sums for eight strips stored next to each other, one strip per lane
+template <typename P>
+static void sums_1d_batch_sse2(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        int32_t * top, int32_t * bottom)
+{
+    __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+
+    for (uint16_t i=1; i+1<numpix; ++i) {
+        const P * f = curr_img + (uint32_t)i*pixstride;
+        __m128i dx = _mm_sub_epi16(load8(f+pixstride), load8(f-pixstride));
+        __m128i dt = _mm_sub_epi16(load8(last_img + (uint32_t)i*pixstride), load8(f));
+        __m128i lo, hi;
+        mul32(dt, dx, &lo, &hi);
+        acc[0] = _mm_add_epi32(acc[0], lo);
+        acc[1] = _mm_add_epi32(acc[1], hi);
+        mul32(dx, dx, &lo, &hi);
+        acc[2] = _mm_add_epi32(acc[2], lo);
+        acc[3] = _mm_add_epi32(acc[3], hi);
+    }
+
+    _mm_storeu_si128((__m128i *)top,        acc[0]);
+    _mm_storeu_si128((__m128i *)(top+4),    acc[1]);
+    _mm_storeu_si128((__m128i *)bottom,     acc[2]);
+    _mm_storeu_si128((__m128i *)(bottom+4), acc[3]);
+}
+
+#pragma GCC pop_options
+
+/*********************************************************************/
+// AVX2: sixteen pixels at a time
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline __m256i load16(const uint8_t * p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+static inline __m256i load16(const uint16_t * p)
+{
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static inline void madd16(__m256i acc[5], __m256i x, __m256i y, __m256i t)
+{
+    acc[0] = _mm256_add_epi32(acc[0], _mm256_madd_epi16(x, x));
+    acc[1] = _mm256_add_epi32(acc[1], _mm256_madd_epi16(y, x));
+    acc[2] = _mm256_add_epi32(acc[2], _mm256_madd_epi16(y, y));
+    acc[3] = _mm256_add_epi32(acc[3], _mm256_madd_epi16(t, x));
+    acc[4] = _mm256_add_epi32(acc[4], _mm256_madd_epi16(t, y));
+}
+
+static void store16(const __m256i acc[5], const uint32_t tail[5], flowsums_t * sums)
+{
+    uint32_t lanes[5][8];
+
+    for (uint8_t k=0; k<5; ++k)
+        _mm256_storeu_si256((__m256i *)lanes[k], acc[k]);
+
+    store_sums(lanes[0], 8, tail, sums);
+}
+
+template <typename P>
+static void sums_plus_avx2(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    __m256i acc[5];
+    for (uint8_t k=0; k<5; ++k)
+        acc[k] = _mm256_setzero_si256();
+
+    uint32_t tail[5] = {0, 0, 0, 0, 0};
+
+    for (uint16_t r=1; r<rows-1; ++r) {
+
+        const P * f = curr_img + (uint32_t)r*curr_stride;
+        const P * z = last_img + (uint32_t)r*last_stride;
+
+        uint16_t c = 1;
+
+        for (; c+16 < cols; c+=16) {
+            __m256i x = _mm256_sub_epi16(load16(f+c-1), load16(f+c+1));
+            __m256i y = _mm256_sub_epi16(load16(f+c-curr_stride), load16(f+c+curr_stride));
+            __m256i t = _mm256_sub_epi16(load16(z+c), load16(f+c));
+            madd16(acc, x, y, t);
+        }
+
+        for (; c<cols-1; ++c)
+            tail_plus(f+c, z+c, curr_stride, tail);
+    }
+
+    store16(acc, tail, sums);
+}
+
+template <typename P>
+static void sums_square_avx2(const P * curr_img, const P * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    __m256i acc[5];
+    for (uint8_t k=0; k<5; ++k)
+        acc[k] = _mm256_setzero_si256();
+
+    uint32_t tail[5] = {0, 0, 0, 0, 0};
+
+    for (uint16_t r=0; r<rows-1; ++r) {
+
+        const P * f = curr_img + (uint32_t)r*curr_stride;
+        const P * z = last_img + (uint32_t)r*last_stride;
+
+        uint16_t c = 0;
+
+        for (; c+16 < cols; c+=16) {
+            __m256i f0 = load16(f+c);
+            __m256i f1 = load16(f+c+1);
+            __m256i f2 = load16(f+c+curr_stride);
+            __m256i f3 = load16(f+c+curr_stride+1);
+            __m256i x = _mm256_add_epi16(_mm256_sub_epi16(f0, f1), _mm256_sub_epi16(f2, f3));
+            __m256i y = _mm256_add_epi16(_mm256_sub_epi16(f0, f2), _mm256_sub_epi16(f1, f3));
+            __m256i t = _mm256_sub_epi16(load16(z+c), f0);
+            madd16(acc, x, y, t);
+        }
+
+        for (; c<cols-1; ++c)
+            tail_square(f+c, z+c, curr_stride, tail);
+    }
+
+    store16(acc, tail, sums);
+}
+
+static void sums_1d_avx2(const pixel_t * curr_img, const pixel_t * last_img, uint16_t numpix, int32_t * top, int32_t * bottom)
+{
+    __m256i tacc = _mm256_setzero_si256();
+    __m256i bacc = _mm256_setzero_si256();
+
+    uint32_t t32 = 0, b32 = 0;
+
+    uint16_t i = 1;
+
+    for (; i+16 < numpix; i+=16) {
+        __m256i dx = _mm256_sub_epi16(load16(curr_img+i+1), load16(curr_img+i-1));
+        __m256i dt = _mm256_sub_epi16(load16(last_img+i), load16(curr_img+i));
+        tacc = _mm256_add_epi32(tacc, _mm256_madd_epi16(dt, dx));
+        bacc = _mm256_add_epi32(bacc, _mm256_madd_epi16(dx, dx));
+    }
+
+    for (; i<numpix-1; ++i) {
+        int32_t dx = (int32_t)curr_img[i+1] - curr_img[i-1];
+        int32_t dt = (int32_t)last_img[i] - curr_img[i];
+        t32 += (uint32_t)(dt * dx);
+        b32 += (uint32_t)(dx * dx);
+    }
+
+    uint32_t lanes[2][8];
+    _mm256_storeu_si256((__m256i *)lanes[0], tacc);
+    _mm256_storeu_si256((__m256i *)lanes[1], bacc);
+
+    for (uint8_t k=0; k<8; ++k) {
+        t32 += lanes[0][k];
+        b32 += lanes[1][k];
+    }
+
+    *top    = (int32_t)t32;
+    *bottom = (int32_t)b32;
+}
+
+// 1D sums for sixteen strips stored next to each other, one strip per lane
+template <typename P>
+static void sums_1d_batch_avx2(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        int32_t * top, int32_t * bottom)
+{
+    __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+
+    for (uint16_t i=1; i+1<numpix; ++i) {
+        const P * f = curr_img + (uint32_t)i*pixstride;
+        __m256i dx = _mm256_sub_epi16(load16(f+pixstride), load16(f-pixstride));
+        __m256i dt = _mm256_sub_epi16(load16(last_img + (uint32_t)i*pixstride), load16(f));
+        __m256i l = _mm256_mullo_epi16(dt, dx);
+        __m256i h = _mm256_mulhi_epi16(dt, dx);
+        acc[0] = _mm256_add_epi32(acc[0], _mm256_unpacklo_epi16(l, h));
+        acc[1] = _mm256_add_epi32(acc[1], _mm256_unpackhi_epi16(l, h));
+        l = _mm256_mullo_epi16(dx, dx);
+        h = _mm256_mulhi_epi16(dx, dx);
+        acc[2] = _mm256_add_epi32(acc[2], _mm256_unpacklo_epi16(l, h));
+        acc[3] = _mm256_add_epi32(acc[3], _mm256_unpackhi_epi16(l, h));
+    }
+
+    // unpacking works within each half, so the low accumulator holds strips 0-3 
+    // and 8-11, and the high one strips 4-7 and 12-15
+    _mm256_storeu_si256((__m256i *)top,        _mm256_permute2x128_si256(acc[0], acc[1], 0x20));
+    _mm256_storeu_si256((__m256i *)(top+8),    _mm256_permute2x128_si256(acc[0], acc[1], 0x31));
+    _mm256_storeu_si256((__m256i *)bottom,     _mm256_permute2x128_si256(acc[2], acc[3], 0x20));
+    _mm256_storeu_si256((__m256i *)(bottom+8), _mm256_permute2x128_si256(acc[2], acc[3], 0x31));
+}
+
+#pragma GCC pop_options
+
+/*********************************************************************/
+// Dispatch according to the processor we are running on
+
+static bool have_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool have_sse2(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+void ofo_sums_plus_rt(const uint8_t * curr_img, const uint8_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    if (have_avx2())
+        sums_plus_avx2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else if (have_sse2())
+        sums_plus_sse2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else
+        ofo_sums_plus<uint8_t,0,0,int16_t,int32_t>(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+}
+
+void ofo_sums_plus_rt(const uint16_t * curr_img, const uint16_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    if (have_avx2())
+        sums_plus_avx2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else if (have_sse2())
+        sums_plus_sse2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else
+        ofo_sums_plus<uint16_t,0,0,int16_t,int32_t>(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+}
+
+void ofo_sums_square_rt(const uint8_t * curr_img, const uint8_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    if (have_avx2())
+        sums_square_avx2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else if (have_sse2())
+        sums_square_sse2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else
+        ofo_sums_square<uint8_t,0,0,int16_t,int32_t>(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+}
+
+void ofo_sums_square_rt(const uint16_t * curr_img, const uint16_t * last_img, uint16_t rows, uint16_t cols, 
+        uint16_t curr_stride, uint16_t last_stride, flowsums_t * sums)
+{
+    if (have_avx2())
+        sums_square_avx2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else if (have_sse2())
+        sums_square_sse2(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+    else
+        ofo_sums_square<uint16_t,0,0,int16_t,int32_t>(curr_img, last_img, rows, cols, curr_stride, last_stride, sums);
+}
+
+void ofo_sums_1d_rt(const pixel_t * curr_img, const pixel_t * last_img, uint16_t numpix, int32_t * top, int32_t * bottom)
+{
+    if (have_avx2())
+        sums_1d_avx2(curr_img, last_img, numpix, top, bottom);
+    else if (have_sse2())
+        sums_1d_sse2(curr_img, last_img, numpix, top, bottom);
+    else
+        ofo_sums_1d(curr_img, last_img, numpix, top, bottom);
+}
+
+// Strips next to each other go sixteen or eight at a time; the rest one at a time
+template <typename P>
+static void sums_1d_batch(const P * curr_img, const P * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, int32_t * top, int32_t * bottom)
+{
+    uint16_t k = 0;
+
+    if (stripstride == 1 && numpix >= 3) {
+
+        if (have_avx2())
+            for (; k+16<=numstrips; k+=16)
+                sums_1d_batch_avx2(curr_img+k, last_img+k, numpix, pixstride, top+k, bottom+k);
+
+        if (have_sse2())
+            for (; k+8<=numstrips; k+=8)
+                sums_1d_batch_sse2(curr_img+k, last_img+k, numpix, pixstride, top+k, bottom+k);
+    }
+
+    ofo_sums_1d_batch(curr_img + (uint32_t)k*stripstride, last_img + (uint32_t)k*stripstride, 
+            numpix, pixstride, numstrips-k, stripstride, top+k, bottom+k);
+}
+
+void ofo_sums_1d_batch_rt(const uint8_t * curr_img, const uint8_t * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, int32_t * top, int32_t * bottom)
+{
+    sums_1d_batch(curr_img, last_img, numpix, pixstride, numstrips, stripstride, top, bottom);
+}
+
+void ofo_sums_1d_batch_rt(const uint16_t * curr_img, const uint16_t * last_img, uint16_t numpix, uint16_t pixstride,
+        uint16_t numstrips, uint16_t stripstride, int32_t * top, int32_t * bottom)
+{
+    sums_1d_batch(curr_img, last_img, numpix, pixstride, numstrips, stripstride, top, bottom);
+}
+
+#endif // OFO_SIMD
@@ -36,16 +36,14 @@ policies, either expressed or implied, of Centeye, Inc.
 #include <SPI.h>	//SPI required for external ADC
 
 /*********************************************************************/
-//SMH System Registers
+// Asynchronous acquisition: value of ready and taken slots when empty, and of the
+// taken slot while getAsyncFrame() is taking a frame
+static const uint8_t ASYNC_NONE  = 0xFF;
+static const uint8_t ASYNC_CLAIM = 0xFE;
 
-static const int SMH_SYS_COLSEL = 0;	//select column
-static const int SMH_SYS_ROWSEL = 1;	//select row
-static const int SMH_SYS_VSW    = 2;	//vertical switching
-static const int SMH_SYS_HSW    = 3;	//horizontal switching
-static const int SMH_SYS_VREF   = 4;	//voltage reference
-static const int SMH_SYS_CONFIG = 5;	//configuration register
-static const int SMH_SYS_NBIAS  = 6;	//nbias
-static const int SMH_SYS_AOBIAS = 7;	//analog out bias
+// Shadow-register bookkeeping
+static const uint16_t KNOWN_PTR  = 0x100;	//pointer value is known
+static const uint16_t MAX_VALUE  = 0xFF;	//largest value we assume a register holds without wrapping
 
 /*********************************************************************/
 
@@ -67,6 +65,15 @@ Stonyman::Stonyman(uint8_t resp, uint8_t incp, uint8_t resv, uint8_t incv, uint8
     _resv = resv;
     _incv = incv;
     _inphi = inphi;
+
+    // chip state is unknown until registers are cleared
+    _ptr = 0;
+    _known = 0;
+    _pulses = 0;
+
+    _async_running = false;
+    _async_ready = ASYNC_NONE;
+    _async_taken = ASYNC_NONE;
 }
 
 void Stonyman::init_pin(uint8_t pin)
@@ -96,37 +103,74 @@ void Stonyman::begin(uint8_t vref, uint8_t nbias, uint8_t aobias, bool selamp)
     use_amp = selamp;
 }
 
-static void pulse(int pin)
+void Stonyman::pulse(uint8_t pin)
 {
     digitalWrite(pin, HIGH);
     delayMicroseconds(1);
     digitalWrite(pin, LOW);
+
+    _pulses++;
+}
+
+uint32_t Stonyman::getPulseCount(void)
+{
+    return _pulses;
+}
+
+void Stonyman::resetPulseCount(void)
+{
+    _pulses = 0;
 }
 
 void Stonyman::set_pointer(uint8_t ptr)
 {
-    // clear pointer
-    pulse(_resp);
+    uint8_t start = _ptr;
+
+    // pointer can only count up, so clear it unless it is known to be at or below target
+    if (!(_known & KNOWN_PTR) || ptr < _ptr) {
+        pulse(_resp);
+        start = 0;
+    }
 
     // increment pointer to desired value
-    for (uint16_t i=0; i!=ptr; ++i) 
+    for (uint16_t i=start; i!=ptr; ++i) 
         pulse(_incp);
+
+    _ptr = ptr;
+    _known |= KNOWN_PTR;
 }
 
 void Stonyman::set_value(uint16_t val) 
 {
-    // clear pointer
-    pulse(_resv);
+    uint16_t start = _regs[_ptr];
+
+    // value can only count up, so clear it unless it is known to be at or below target
+    if (!(_known & KNOWN_PTR) || !(_known & (1<<_ptr)) || val < start) {
+        pulse(_resv);
+        start = 0;
+    }
 
-    // increment pointer
-    for (uint16_t i=0; i!=val; ++i) 
+    // increment value
+    for (uint16_t i=start; i!=val; ++i) 
         pulse(_incv);
+
+    _regs[_ptr] = val;
+    _known |= (1<<_ptr);
 }
 
 void Stonyman::inc_value(uint16_t val) 
 {
-    for (uint16_t i=0; i<val; ++i) //increment pointer
+    for (uint16_t i=0; i<val; ++i) //increment value
         pulse(_incv);
+
+    if (_known & KNOWN_PTR) {
+
+        _regs[_ptr] += val;
+
+        // past this point we can't be sure the register hasn't wrapped
+        if (_regs[_ptr] > MAX_VALUE)
+            _known &= ~(1<<_ptr);
+    }
 }
 
 void Stonyman::pulse_inphi(uint8_t delay) 
@@ -143,6 +187,9 @@ void Stonyman::set_pointer_value(uint8_t ptr,uint16_t val)
 
 void Stonyman::clear_values(void)
 {
+    // forget anything we thought we knew, forcing a reset of each register
+    _known = 0;
+
     for (uint8_t i=0; i!=8; ++i)
         set_pointer_value(i,0);	//set each register to zero
 }
@@ -256,91 +303,138 @@ void Stonyman::setBinning(uint8_t hbin,uint8_t vbin)
     set_pointer_value(SMH_SYS_VSW,vsw);
 }
 
-void Stonyman::processFrame(FrameGrabber & grabber, uint8_t input, ImageBounds & bounds, bool digital)
+uint16_t Stonyman::read_pixel(uint8_t input)
 {
-    (void)digital;
-
-    grabber.preProcess();
-
-    set_pointer_value(SMH_SYS_ROWSEL, bounds._rowstart);
-
-    for (uint8_t row=0; row<bounds._numrows; row++) {
-
-        set_pointer_value(SMH_SYS_COLSEL, bounds._colstart);
-
-        grabber.handleVectorStart();
-
-        for (uint8_t col=0; col<bounds._numcols; col++) {
-
-            // settling delay
-            delayMicroseconds(1);
-
-            // pulse amplifier if needed
-            if (use_amp) 
-                pulse_inphi(2);
+    // settling delay
+    delayMicroseconds(1);
 
-            delayMicroseconds(1);
+    // pulse amplifier if needed
+    if (use_amp) 
+        pulse_inphi(2);
 
-            uint16_t val = analogRead(input); // acquire pixel
+    delayMicroseconds(1);
 
-            grabber.handlePixel(row, col, val, use_amp);
+    return analogRead(input); // acquire pixel
+}
 
-            inc_value(bounds._colstride);
-        }
+void Stonyman::processFrame(FrameGrabber & grabber, uint8_t input, ImageBounds & bounds, bool digital)
+{
+    processFrame<FrameGrabber>(grabber, input, bounds, digital);
+}
 
-        set_pointer(SMH_SYS_ROWSEL);
-        inc_value(bounds._rowstride); // go to next row
+void Stonyman::processFrameVertical(FrameGrabber & grabber, uint8_t input, ImageBounds & bounds, bool digital)
+{
+    processFrameVertical<FrameGrabber>(grabber, input, bounds, digital);
+}
 
-        grabber.handleVectorEnd();
-    }
+void Stonyman::startAsync(uint16_t * buf1, uint16_t * buf2, uint8_t input, ImageBounds & bounds)
+{
+    _async_running = false;
+
+    _async_buf[0] = buf1;
+    _async_buf[1] = buf2;
+    _async_input = input;
+    _async_bounds = bounds;
+    _async_write = 0;
+    _async_row = 0;
+    _async_col = 0;
+    _async_pix = buf1;
+    _async_dropped = 0;
+
+    __atomic_store_n(&_async_ready, ASYNC_NONE, __ATOMIC_RELEASE);
+    __atomic_store_n(&_async_taken, ASYNC_NONE, __ATOMIC_RELEASE);
+
+    // go to first row
+    set_pointer_value(SMH_SYS_ROWSEL, bounds._rowstart);
 
-    grabber.postProcess();
+    __atomic_store_n(&_async_running, true, __ATOMIC_RELEASE);
 }
 
-void Stonyman::processFrameVertical(FrameGrabber & grabber, uint8_t input, ImageBounds & bounds, bool digital)
+void Stonyman::stepAsync(void)
 {
-    (void)digital;
+    if (!__atomic_load_n(&_async_running, __ATOMIC_ACQUIRE))
+        return;
 
-    // Go to first col (NB: columns are outer loop)
-    set_pointer_value(SMH_SYS_COLSEL,bounds._colstart);
+    // go to first column at start of row
+    if (_async_col == 0)
+        set_pointer_value(SMH_SYS_COLSEL, _async_bounds._colstart);
 
-    // Do pre-processing
-    grabber.preProcess();
+    *_async_pix++ = read_pixel(_async_input); // acquire pixel
 
-    // Loop through all cols
-    for (uint8_t col=bounds._colstart; col<bounds._numcols; col+=bounds._colstride) {
+    inc_value(_async_bounds._colstride);
 
-        // Go to first row
-        set_pointer_value(SMH_SYS_ROWSEL,bounds._rowstart);
+    if (++_async_col < _async_bounds._numcols)
+        return;
 
-        // Do stuff at start of column
-        grabber.handleVectorStart();
+    // end of row: go to next row
+    _async_col = 0;
+    set_pointer(SMH_SYS_ROWSEL);
+    inc_value(_async_bounds._rowstride);
 
-        // Loop through all rows
-        for (uint8_t row=bounds._rowstart; row<bounds._numrows; row+=bounds._rowstride) {
+    if (++_async_row < _async_bounds._numrows)
+        return;
 
-            // settling delay
-            delayMicroseconds(1);
+    // end of frame: hand it over, replacing any unread frame, and switch to the 
+    // other buffer; if the consumer holds the other buffer, or is taking the 
+    // unread frame, drop the new frame and reuse this one.  The consumer cannot 
+    // interrupt us, so the slots are read and written together.
+    uint8_t ready = __atomic_load_n(&_async_ready, __ATOMIC_ACQUIRE);
 
-            // pulse amplifier if needed
-            if (use_amp) 
-                pulse_inphi(2);
+    if (__atomic_load_n(&_async_taken, __ATOMIC_ACQUIRE) == ASYNC_NONE) {
+        __atomic_store_n(&_async_ready, _async_write, __ATOMIC_RELEASE);
+        _async_write = 1 - _async_write;
+        if (ready != ASYNC_NONE)
+            _async_dropped++;
+    }
+    else
+        _async_dropped++;
 
-            // get data value
-            delayMicroseconds(1);
+    // start next frame
+    _async_row = 0;
+    _async_pix = _async_buf[_async_write];
+    set_pointer_value(SMH_SYS_ROWSEL, _async_bounds._rowstart);
+}
 
-            uint16_t val = analogRead(input); // acquire pixel
+uint16_t * Stonyman::getAsyncFrame(void)
+{
+    uint8_t taken = __atomic_load_n(&_async_taken, __ATOMIC_ACQUIRE);
+
+    // take the unread frame.  Claiming the taken slot first stops stepAsync() from
+    // handing over frames (it drops them instead), so the ready slot cannot change
+    // between our reading and emptying it; each step is a single-byte load or 
+    // store, so interrupts stay enabled.
+    if (taken == ASYNC_NONE) {
+        __atomic_store_n(&_async_taken, ASYNC_CLAIM, __ATOMIC_SEQ_CST);
+        taken = __atomic_load_n(&_async_ready, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&_async_ready, ASYNC_NONE, __ATOMIC_RELEASE);
+        __atomic_store_n(&_async_taken, taken, __ATOMIC_RELEASE);
+    }
 
-            grabber.handlePixel(row, col, val, use_amp);
+    return taken == ASYNC_NONE ? NULL : _async_buf[taken];
+}
 
-            inc_value(bounds._rowstride); // go to next row
-        }
+void Stonyman::releaseAsyncFrame(void)
+{
+    __atomic_store_n(&_async_taken, ASYNC_NONE, __ATOMIC_RELEASE);
+}
 
-        set_pointer(SMH_SYS_COLSEL);
-        inc_value(bounds._colstride); // go to next col
+uint32_t Stonyman::getAsyncDropped(void)
+{
+    // the count takes several instructions to read on eight-bit processors, so 
+    // stepAsync() may change it part way through; read it until two reads agree
+    const volatile uint32_t * count = &_async_dropped;
 
-        grabber.handleVectorEnd();
-    }
+    uint32_t dropped;
+    do
+        dropped = *count;
+    while (dropped != *count);
 
-    grabber.postProcess();
+    return dropped;
+}
+
+void Stonyman::stopAsync(void)
+{
+    __atomic_store_n(&_async_running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&_async_ready, ASYNC_NONE, __ATOMIC_RELEASE);
+    __atomic_store_n(&_async_taken, ASYNC_NONE, __ATOMIC_RELEASE);
 }
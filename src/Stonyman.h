@@ -33,6 +33,7 @@ policies, either expressed or implied, of Centeye, Inc.
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 #if defined (__AVR_ATmega8__)||(__AVR_ATmega168__)|  	(__AVR_ATmega168P__)||(__AVR_ATmega328P__)
 
@@ -93,6 +94,25 @@ class FrameGrabber {
         (void)row; (void)col; (void)pixel; (void)use_amp;
     }
 
+    /**
+     * Returns a buffer to receive the pixels of the next row or column, or
+     * NULL to receive them one at a time through handlePixel().  If a buffer is 
+     * returned, the pixels are stored in it as they are read, and handleRow() 
+     * is called once the row or column is complete.  The buffer must be big 
+     * enough to hold a full row or column.
+     */
+    virtual uint16_t * getRowBuffer(void) { return NULL; }
+
+    /**
+     * Does something useful with a row or column of pixels just read into the 
+     * buffer returned by getRowBuffer().  The row or column is numbered from zero,
+     * in the order read.
+     */
+    virtual void handleRow(uint8_t row, const uint16_t * pixels, uint8_t n)
+    {
+        (void)row; (void)pixels; (void)n;
+    }
+
     /**
      * Does something useful at the start of a row or column.
      */
@@ -258,6 +278,20 @@ class Stonyman
            */
          void processFrame(FrameGrabber & fg, uint8_t input, ImageBounds & bounds, bool digital=false);
 
+         /**
+           * Same as above, compiled for a specific FrameGrabber subclass.  This version
+           * is chosen automatically when the grabber's own type is known, so its 
+           * methods can be called directly (and inlined) rather than through the
+           * virtual-function table.  Declaring the subclass <tt>final</tt> lets the 
+           * compiler take advantage of this.  The pixel reads and register pulses,
+           * however, are then called from outside Stonyman.cpp rather than inlined
+           * there, so unless the grabber's per-pixel work is what dominates, this
+           * version is no faster; on a host computer it is up to a quarter slower
+           * (see extras/standalone/grabbench.cpp).
+           */
+         template <class Grabber>
+         void processFrame(Grabber & fg, uint8_t input, ImageBounds & bounds, bool digital=false);
+
          /**
            * Processes one frame of image data from Stonyman2 in column-wise order.
            *
@@ -268,8 +302,98 @@ class Stonyman
            */
          void processFrameVertical(FrameGrabber & fg, uint8_t input, ImageBounds & bounds, bool digital=false);
 
+         /**
+           * Same as above, compiled for a specific FrameGrabber subclass.
+           */
+         template <class Grabber>
+         void processFrameVertical(Grabber & fg, uint8_t input, ImageBounds & bounds, bool digital=false);
+
+         /**
+           * Starts acquiring frames asynchronously, alternating between two image buffers.
+           * Acquisition proceeds one pixel at a time, as stepAsync() is called (typically 
+           * from a timer interrupt), and completed frames are handed over through 
+           * getAsyncFrame().  While acquisition is running, no other method of this object
+           * should be called except stepAsync(), getAsyncFrame(), releaseAsyncFrame(), 
+           * getAsyncDropped(), and stopAsync().
+           *
+           * @param buf1 first image buffer (big enough for the bounds)
+           * @param buf2 second image buffer (big enough for the bounds)
+           * @param input input pin number
+           * @param bounds ImageBounds object
+           */
+         void startAsync(uint16_t * buf1, uint16_t * buf2, uint8_t input, ImageBounds & bounds);
+
+         /**
+           * Reads the next pixel of an asynchronous acquisition.  Safe to call from an
+           * interrupt service routine.  When the last pixel of a frame is read, the frame
+           * is handed over to getAsyncFrame(), replacing (and dropping) any frame that
+           * has not been taken yet, so that the freshest frame is always the one handed
+           * over.  Only if the caller still holds the other buffer, having taken a frame
+           * and not released it, is the new frame dropped instead and its buffer reused.
+           * Assumes that the other asynchronous methods do not interrupt it, as holds 
+           * when it is called from an interrupt service routine.
+           */
+         void stepAsync(void);
+
+         /**
+           * Takes the most recent completed frame of an asynchronous acquisition.  The frame
+           * belongs to the caller, and will not be overwritten, until releaseAsyncFrame() 
+           * is called; until then, this returns the same frame.  Interrupts stay enabled:
+           * the frame is taken with single-byte loads and stores, and a frame completed
+           * by stepAsync() during those few instructions is dropped rather than handed 
+           * over.  Meant for a single producer (stepAsync() in an interrupt service 
+           * routine) and a single consumer on one processor core.
+           *
+           * @return image pixels, or NULL if no new frame is available
+           */
+         uint16_t * getAsyncFrame(void);
+
+         /**
+           * Releases the frame obtained from getAsyncFrame(), allowing the next
+           * completed frame to be handed over.
+           */
+         void releaseAsyncFrame(void);
+
+         /**
+           * Returns the number of frames dropped: frames replaced by a fresher one before
+           * being taken, and frames completed while the other buffer was held or a frame
+           * was being taken.  Interrupts stay enabled; the count is read until two reads
+           * agree.
+           *
+           * @return number of frames dropped
+           */
+         uint32_t getAsyncDropped(void);
+
+         /**
+           * Stops asynchronous acquisition.  The chip can then be used normally.
+           */
+         void stopAsync(void);
+
+         /**
+           * Returns the number of reset, increment, and amplifier pulses sent to the chip since the 
+           * last call to resetPulseCount().  Useful for measuring register-access cost.
+           *
+           * @return number of pulses
+           */
+         uint32_t getPulseCount(void);
+
+         /**
+           * Zeroes the pulse count returned by getPulseCount().
+           */
+         void resetPulseCount(void);
+
     private:
 
+        // SMH System Registers
+        static const uint8_t SMH_SYS_COLSEL = 0;	//select column
+        static const uint8_t SMH_SYS_ROWSEL = 1;	//select row
+        static const uint8_t SMH_SYS_VSW    = 2;	//vertical switching
+        static const uint8_t SMH_SYS_HSW    = 3;	//horizontal switching
+        static const uint8_t SMH_SYS_VREF   = 4;	//voltage reference
+        static const uint8_t SMH_SYS_CONFIG = 5;	//configuration register
+        static const uint8_t SMH_SYS_NBIAS  = 6;	//nbias
+        static const uint8_t SMH_SYS_AOBIAS = 7;	//analog out bias
+
         //indicates whether amplifier is in use 
         bool use_amp;
 
@@ -280,8 +404,43 @@ class Stonyman
         uint8_t _incv;
         uint8_t _inphi;
 
+        // Shadow copies of the chip's register pointer and of the eight system 
+        // registers, so that a register can be reached by incrementing from its
+        // current value instead of resetting it and counting up from zero.  
+        // Bit i of _known is set when register i holds a known value; bit 
+        // 8 is set when the pointer holds a known value.
+        uint8_t  _ptr;
+        uint16_t _regs[8];
+        uint16_t _known;
+
+        // number of pulses sent
+        uint32_t _pulses;
+
+        // Asynchronous acquisition state.  The producer (stepAsync) writes into
+        // _async_buf[_async_write]; a completed frame is handed to the consumer
+        // by storing its index in the slot _async_ready, which only the producer 
+        // fills.  The consumer takes the frame by moving its index to _async_taken
+        // and releases it by emptying that slot, which only the consumer fills; 
+        // while moving the index, the consumer marks the taken slot as claimed, 
+        // and the producer hands nothing over.  At most one of the two slots holds
+        // a buffer, so the producer always has a buffer to write into.
+        uint16_t *  _async_buf[2];
+        uint16_t *  _async_pix;
+        ImageBounds _async_bounds;
+        uint8_t     _async_input;
+        uint8_t     _async_row;
+        uint8_t     _async_col;
+        uint8_t     _async_write;
+        uint8_t     _async_ready;
+        uint8_t     _async_taken;
+        bool        _async_running;
+        uint32_t    _async_dropped;
+
         static void init_pin(uint8_t pin);
 
+        // Pulses a pin high then low, counting the pulse
+        void pulse(uint8_t pin);
+
         /*********************************************************************/
         // Chip Register and Value Manipulation
 
@@ -305,4 +464,98 @@ class Stonyman
         //	Sets the pointer to a register and sets the value of that        
         //	register
         void set_pointer_value(uint8_t ptr,uint16_t val);
+
+        //	Waits for the current pixel to settle, pulses the amplifier if
+        //	needed, and reads the pixel from the specified input
+        uint16_t read_pixel(uint8_t input);
 };
+
+template <class Grabber>
+void Stonyman::processFrame(Grabber & grabber, uint8_t input, ImageBounds & bounds, bool digital)
+{
+    (void)digital;
+
+    grabber.preProcess();
+
+    set_pointer_value(SMH_SYS_ROWSEL, bounds._rowstart);
+
+    for (uint8_t row=0; row<bounds._numrows; row++) {
+
+        set_pointer_value(SMH_SYS_COLSEL, bounds._colstart);
+
+        grabber.handleVectorStart();
+
+        uint16_t * rowbuf = grabber.getRowBuffer();
+
+        for (uint8_t col=0; col<bounds._numcols; col++) {
+
+            uint16_t val = read_pixel(input); // acquire pixel
+
+            if (rowbuf)
+                rowbuf[col] = val;
+            else
+                grabber.handlePixel(row, col, val, use_amp);
+
+            inc_value(bounds._colstride);
+        }
+
+        if (rowbuf)
+            grabber.handleRow(row, rowbuf, bounds._numcols);
+
+        set_pointer(SMH_SYS_ROWSEL);
+        inc_value(bounds._rowstride); // go to next row
+
+        grabber.handleVectorEnd();
+    }
+
+    grabber.postProcess();
+}
+
+template <class Grabber>
+void Stonyman::processFrameVertical(Grabber & grabber, uint8_t input, ImageBounds & bounds, bool digital)
+{
+    (void)digital;
+
+    // Go to first col (NB: columns are outer loop)
+    set_pointer_value(SMH_SYS_COLSEL,bounds._colstart);
+
+    // Do pre-processing
+    grabber.preProcess();
+
+    // Loop through all cols, counting them from zero for handleRow()
+    uint8_t index = 0;
+    for (uint8_t col=bounds._colstart; col<bounds._numcols; col+=bounds._colstride, index++) {
+
+        // Go to first row
+        set_pointer_value(SMH_SYS_ROWSEL,bounds._rowstart);
+
+        // Do stuff at start of column
+        grabber.handleVectorStart();
+
+        uint16_t * colbuf = grabber.getRowBuffer();
+        uint8_t n = 0;
+
+        // Loop through all rows
+        for (uint8_t row=bounds._rowstart; row<bounds._numrows; row+=bounds._rowstride) {
+
+            uint16_t val = read_pixel(input); // acquire pixel
+
+            if (colbuf)
+                colbuf[n++] = val;
+            else
+                grabber.handlePixel(row, col, val, use_amp);
+
+            inc_value(bounds._rowstride); // go to next row
+        }
+
+        if (colbuf)
+            grabber.handleRow(index, colbuf, n);
+
+        set_pointer(SMH_SYS_COLSEL);
+        inc_value(bounds._colstride); // go to next col
+
+        grabber.handleVectorEnd();
+    }
+
+    grabber.postProcess();
+}
@@ -30,10 +30,14 @@ policies, either expressed or implied, of Centeye, Inc.
 */
 
 #include <StonymanUtils.h>
+#include <ImageUtils.h>
 #include <Arduino.h>
 
+// largest number of pixels in a row or column of the chip
+static const uint8_t CHIP_SIZE = 112;
+
 //helper class for grabbing images and storing them in an array
-class ArrayFrameGrabber : public FrameGrabber {
+class ArrayFrameGrabber final : public FrameGrabber {
 
     friend class Stonyman;
 
@@ -49,13 +53,18 @@ class ArrayFrameGrabber : public FrameGrabber {
         _pimg = _img;
     }
 
-    virtual void handlePixel(uint8_t row, uint8_t col, uint16_t pixel, bool use_amp) override 
+    // rows are read directly into the image
+    virtual uint16_t * getRowBuffer(void) override
+    {
+        return _pimg;
+    }
+
+    virtual void handleRow(uint8_t row, const uint16_t * pixels, uint8_t n) override
     {
         (void)row;
-        (void)col;
-        (void)use_amp;
+        (void)pixels;
 
-        *_pimg++ = pixel;
+        _pimg += n;
     }
 
     public:
@@ -78,60 +87,89 @@ void stonymanGetImage(Stonyman & stonyman, uint16_t *img, uint8_t input, bool di
     stonymanGetImage(stonyman, img, input, stonyman.FULLBOUNDS, digital);
 }
 
-// helper class for computing row sums
-class SumFrameGrabber : public FrameGrabber {
+// helper class for computing row sums, reading each row into the caller's buffer
+// if there is one, and otherwise summing pixel by pixel
+class SumFrameGrabber final : public FrameGrabber {
 
     friend class Stonyman;
 
     private:
 
     uint16_t * pimg;
-    uint16_t total;
+    uint16_t * rowbuf;
+    uint32_t total;
 
     protected:
 
-    virtual void handleVectorStart(void) 
-    { 
+    virtual uint16_t * getRowBuffer(void) override
+    {
+        return rowbuf;
+    }
+
+    virtual void handleVectorStart(void) override
+    {
         total = 0;
     }
 
-    virtual void handlePixel(uint8_t row, uint8_t col, uint16_t pixel, bool use_amp) 
-    { 
-        (void)row; 
-        (void)col; 
+    virtual void handlePixel(uint8_t row, uint8_t col, uint16_t pixel, bool use_amp) override
+    {
+        (void)row;
+        (void)col;
         (void)use_amp;
 
         total += pixel;
     }
 
-    virtual void handleVectorEnd(void) 
+    virtual void handleRow(uint8_t row, const uint16_t * pixels, uint8_t n) override
+    {
+        (void)row;
+
+        for (uint8_t i=0; i<n; ++i)
+            total += pixels[i];
+    }
+
+    virtual void handleVectorEnd(void) override
     {
         *pimg++ = total>>4; // store pixel divide to avoid overflow, then advance pointer
     }
 
     public:
 
-    SumFrameGrabber(uint16_t * img) 
+    SumFrameGrabber(uint16_t * img, uint16_t * buf) 
     {
         pimg = img;
+        rowbuf = buf;
+        total = 0;
     }
 };
 
 
 void stonymanGetRowSum(Stonyman & stonyman, uint16_t *img, uint8_t input, ImageBounds & bounds, bool digital)
 {
-    SumFrameGrabber fg(img);
+    SumFrameGrabber fg(img, NULL);
+    stonyman.processFrame(fg, input, bounds, digital);
+}
+
+void stonymanGetRowSum(Stonyman & stonyman, uint16_t *img, uint16_t *rowbuf, uint8_t input, ImageBounds & bounds, bool digital)
+{
+    SumFrameGrabber fg(img, rowbuf);
     stonyman.processFrame(fg, input, bounds, digital);
 }
 
 void stonymanGetColSum(Stonyman & stonyman, uint16_t *img, uint8_t input, ImageBounds & bounds, bool digital)
 {
-    SumFrameGrabber fg(img);
+    SumFrameGrabber fg(img, NULL);
+    stonyman.processFrameVertical(fg, input, bounds, digital);
+}
+
+void stonymanGetColSum(Stonyman & stonyman, uint16_t *img, uint16_t *colbuf, uint8_t input, ImageBounds & bounds, bool digital)
+{
+    SumFrameGrabber fg(img, colbuf);
     stonyman.processFrameVertical(fg, input, bounds, digital);
 }
 
 //helper class for finding maximum pixel values in image
-class MaxFrameGrabber : public FrameGrabber {
+class MaxFrameGrabber final : public FrameGrabber {
 
     friend class Stonyman;
 
@@ -182,7 +220,7 @@ void stonymanFindMax(Stonyman & stonyman, uint8_t input, uint8_t *maxrow, uint8_
 }
 
 //helper class for generating Matlab-formatted output
-class MatlabFrameGrabber : public FrameGrabber {
+class MatlabFrameGrabber final : public FrameGrabber {
 
     friend class Stonyman;
 
@@ -225,3 +263,171 @@ void stonymanDumpMatlab(Stonyman & stonyman, uint8_t input, bool digital)
     stonymanDumpMatlab(stonyman, input, stonyman.FULLBOUNDS, digital);
 }
 
+
+FlowFrameGrabber::FlowFrameGrabber(uint8_t rows, uint8_t cols, uint16_t scale)
+{
+    _curr = _ring.current();
+    _last = _ring.previous();
+    _rows = rows;
+    _cols = cols;
+    _scale = scale;
+    _method = OFO_IIA_PLUS;
+    _mask = NULL;
+    _maskBase = 0;
+    setGrid(1);
+}
+
+void FlowFrameGrabber::setMethod(uint8_t method)
+{
+    _method = method;
+}
+
+void FlowFrameGrabber::setGrid(uint8_t grid)
+{
+    if (grid < 1)
+        grid = 1;
+    if (grid > OFO_TUNE_GRID)
+        grid = OFO_TUNE_GRID;
+
+    _grid = grid;
+    _prows = _rows / grid;
+    _pcols = _cols / grid;
+
+    memset(_ofx, 0, sizeof(_ofx));
+    memset(_ofy, 0, sizeof(_ofy));
+}
+
+void FlowFrameGrabber::setMask(uint8_t * mask, uint16_t maskBase)
+{
+    _mask = mask;
+    _maskBase = maskBase;
+}
+
+uint16_t * FlowFrameGrabber::getImage(void)
+{
+    return _curr;
+}
+
+uint16_t * FlowFrameGrabber::getPreviousImage(void)
+{
+    return _last;
+}
+
+void FlowFrameGrabber::getFlow(int16_t * ofx, int16_t * ofy)
+{
+    const uint8_t n = _grid * _grid;
+
+    int32_t sx = 0;
+    int32_t sy = 0;
+
+    for (uint8_t k=0; k<n; ++k) {
+        sx += _ofx[k];
+        sy += _ofy[k];
+    }
+
+    *ofx = (int16_t)(sx / n);
+    *ofy = (int16_t)(sy / n);
+}
+
+void FlowFrameGrabber::getGridFlow(int16_t * ofx, int16_t * ofy)
+{
+    const uint8_t n = _grid * _grid;
+
+    memcpy(ofx, _ofx, n*sizeof(int16_t));
+    memcpy(ofy, _ofy, n*sizeof(int16_t));
+}
+
+void FlowFrameGrabber::preProcess(void)
+{
+    // current image becomes previous; oldest buffer is reused for the new image
+    _curr = _ring.rotate();
+    _last = _ring.previous();
+
+    _pimg = _curr;
+    _pmask = _mask;
+    _row = 0;
+
+    memset(_sums, 0, sizeof(_sums));
+}
+
+uint16_t * FlowFrameGrabber::getRowBuffer(void)
+{
+    // rows are read directly into the current image
+    return _pimg;
+}
+
+void FlowFrameGrabber::handleRow(uint8_t row, const uint16_t * pixels, uint8_t n)
+{
+    (void)row;
+    (void)pixels;
+
+    // subtract FPN mask from the row just read
+    if (_pmask) {
+        imgApplyMask(_pimg, n, _pmask, _maskBase);
+        _pmask += n;
+    }
+
+    _pimg += n;
+    _row++;
+
+    // plus configuration needs rows above and below the center row; square
+    // configuration needs the row and the one below it
+    const bool plus = _method == OFO_IIA_PLUS || _method == OFO_LK_PLUS;
+    const uint8_t k = plus ? 3 : 2;
+
+    // add the rows just read to the sums of their patches, if they all lie in 
+    // the same row of patches
+    if (_prows && _row >= k) {
+
+        const uint8_t i = (_row-k) / _prows;
+
+        if (i < _grid && (_row-1) / _prows == i) {
+
+            const uint16_t offset = (_row-k) * _cols;
+
+            ImageView<uint16_t> curr(_curr+offset, k, _cols);
+            ImageView<uint16_t> last(_last+offset, k, _cols);
+
+            for (uint8_t j=0; j<_grid; ++j) {
+
+                ImageView<uint16_t> c = curr.window(0, j*_pcols, k, _pcols);
+                ImageView<uint16_t> l = last.window(0, j*_pcols, k, _pcols);
+
+                flowsums_t rowsums;
+
+                // ten-bit pixels, which span eleven bits once masked
+                if (plus)
+                    ofoSums_Plus_2D<uint16_t, 11>(c, l, &rowsums);
+                else
+                    ofoSums_Square_2D<uint16_t, 11>(c, l, &rowsums);
+
+                _sums[j].A11 += rowsums.A11;
+                _sums[j].A12 += rowsums.A12;
+                _sums[j].A22 += rowsums.A22;
+                _sums[j].b1  += rowsums.b1;
+                _sums[j].b2  += rowsums.b2;
+            }
+        }
+    }
+
+    // solve each row of patches as soon as its last row has been read
+    if (_prows && _row % _prows == 0 && _row / _prows <= _grid) {
+
+        const uint8_t i = _row / _prows - 1;
+
+        for (uint8_t j=0; j<_grid; ++j) {
+
+            const uint8_t p = i*_grid + j;
+
+            flowsums_t sums;
+            ofo_narrow(_sums[j], &sums);
+
+            if (_method == OFO_IIA_PLUS || _method == OFO_IIA_SQUARE)
+                ofoIIA_Solve(&sums, _scale, &_ofx[p], &_ofy[p]);
+            else
+                ofoLK_Solve(&sums, _scale, &_ofx[p], &_ofy[p]);
+        }
+
+        memset(_sums, 0, sizeof(_sums));
+    }
+}
@@ -34,6 +34,118 @@
 
 #include <stdint.h>
 #include <Stonyman.h>
+#include <OpticalFlow.h>
+#include <ImageUtils.h>
+
+/**
+ * A FrameGrabber that computes optical flow while the image is being read.
+ * Each row has the FPN mask applied as it arrives, and the gradient sums
+ * are accumulated as soon as the rows they need have been read, so the flow
+ * is available as soon as Stonyman::processFrame() returns.  The grabber
+ * keeps the current and previous images in a FrameRing, so the previous image
+ * never has to be copied.  The image can also be divided into a grid of patches
+ * (as chosen by ofoAutotune()), each of which gets its own flow, again without 
+ * a further pass over the image.
+ */
+class FlowFrameGrabber final : public FrameGrabber {
+
+    friend class Stonyman;
+
+    private:
+
+    FrameRing<uint16_t, 2, MAX_PIXELS> _ring;
+
+    uint16_t * _curr;
+    uint16_t * _last;
+    uint16_t * _pimg;
+    uint8_t  * _pmask;
+
+    uint8_t * _mask;
+    uint16_t  _maskBase;
+
+    uint8_t  _rows;
+    uint8_t  _cols;
+    uint8_t  _row;
+    uint8_t  _method;
+    uint16_t _scale;
+
+    uint8_t  _grid;
+    uint8_t  _prows;
+    uint8_t  _pcols;
+
+    // sums for the patches of the row of patches being read
+    FlowSums<int64_t> _sums[OFO_TUNE_GRID];
+
+    int16_t _ofx[OFO_TUNE_GRID*OFO_TUNE_GRID];
+    int16_t _ofy[OFO_TUNE_GRID*OFO_TUNE_GRID];
+
+    protected:
+
+    virtual void preProcess(void) override;
+    virtual uint16_t * getRowBuffer(void) override;
+    virtual void handleRow(uint8_t row, const uint16_t * pixels, uint8_t n) override;
+
+    public:
+
+    /**
+     * Constructs a FlowFrameGrabber.
+     *
+     * @param rows number of rows in image (should agree with ImageBounds; at most MAX_ROWS)
+     * @param cols number of cols in image (should agree with ImageBounds; at most MAX_COLS)
+     * @param scale value of one pixel of motion (for scaling output)
+     */
+    FlowFrameGrabber(uint8_t rows, uint8_t cols, uint16_t scale=200);
+
+    /**
+     * Selects the optical-flow method.
+     * @param method one of OFO_IIA_PLUS, OFO_IIA_SQUARE, OFO_LK_PLUS, OFO_LK_SQUARE
+     */
+    void setMethod(uint8_t method);
+
+    /**
+     * Divides the image into a grid of patches, each with its own flow, as in
+     * ofoFlow_2D() on each patch.  Rows and columns of pixels left over when the
+     * image does not divide evenly are not used.
+     * @param grid number of rows and columns of patches, from 1 (the whole image) 
+     * to OFO_TUNE_GRID
+     */
+    void setGrid(uint8_t grid);
+
+    /**
+     * Sets the fixed-pattern-noise mask applied to each pixel as it is read,
+     * as with imgApplyMask().  With no mask, raw pixels are stored.
+     * @param mask the image mask (should be same size as image), or NULL for none
+     * @param maskBase smallest value of any pixel in the calibration image
+     */
+    void setMask(uint8_t * mask, uint16_t maskBase);
+
+    /**
+     * Returns the most recently acquired (masked) image.
+     * @return image pixels
+     */
+    uint16_t * getImage(void);
+
+    /**
+     * Returns the image acquired before the most recent one.
+     * @return image pixels
+     */
+    uint16_t * getPreviousImage(void);
+
+    /**
+     * Gets the optical flow between the two most recent images; with a grid of
+     * patches, the average of their flows.
+     * @param ofx pointer to integer value for X shift.
+     * @param ofy pointer to integer value for Y shift.
+     */
+    void getFlow(int16_t * ofx, int16_t * ofy);
+
+    /**
+     * Gets the optical flow of each patch of the grid set by setGrid().
+     * @param ofx gets the X shifts, one per patch, row by row
+     * @param ofy gets the Y shifts
+     */
+    void getGridFlow(int16_t * ofx, int16_t * ofy);
+};
 
 /**
  * Acquires a box section of an image and and saves to image array img.  Note 
@@ -67,6 +179,20 @@ void stonymanGetImage(Stonyman & stonyman, uint16_t *img, uint8_t input, bool di
 void stonymanGetRowSum(Stonyman & stonyman, uint16_t *img, uint8_t input, ImageBounds & bounds, bool digital=false);
 void stonymanGetRowSum(Stonyman & stonyman, uint16_t *img, uint8_t input, bool digital=false);
 
+/**
+ * Same as above, reading each row into a buffer and summing it in one pass, which 
+ * is faster than summing pixel by pixel.  The buffer is the caller's, so that it 
+ * can be static rather than on the stack.
+ *
+ * @param stonyman a Stonyman object whose begin() method has been called
+ * @param img (output): pointer to image array, an array of signed uint16_ts
+ * @param rowbuf buffer big enough for one row of the bounds
+ * @param input which analog input pin to use
+ * @param bounds ImageBounds object
+ * @param optional bool digital= flag for using SPI (default=false, use Arduino ADC)
+ */
+void stonymanGetRowSum(Stonyman & stonyman, uint16_t *img, uint16_t *rowbuf, uint8_t input, ImageBounds & bounds, bool digital=false);
+
 /**
  * Acquires a box section of a Stonyman or Hawksbill 
  * and saves to image array img.  However, each col of the image
@@ -84,6 +210,19 @@ void stonymanGetRowSum(Stonyman & stonyman, uint16_t *img, uint8_t input, bool d
 void stonymanGetColSum(Stonyman & stonyman, uint16_t *img, uint8_t input, ImageBounds & bounds, bool digital=false);
 void stonymanGetColSum(Stonyman & stonyman, uint16_t *img, uint8_t input, bool digital=false);
 
+/**
+ * Same as above, reading each column into a buffer and summing it in one pass; see 
+ * the buffered stonymanGetRowSum().
+ *
+ * @param stonyman a Stonyman object whose begin() method has been called
+ * @param img (output) pointer to image array, an array of signed uint16_ts
+ * @param colbuf buffer big enough for one column of the bounds
+ * @param input which analog input pin to use
+ * @param bounds ImageBounds object
+ * @param optional bool digital= flag for using SPI (default=false, use Arduino ADC)
+ */
+void stonymanGetColSum(Stonyman & stonyman, uint16_t *img, uint16_t *colbuf, uint8_t input, ImageBounds & bounds, bool digital=false);
+
 
 /**
  * Searches over a block section of a Stonyman chip